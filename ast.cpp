@@ -16,6 +16,14 @@ void VariableExprAST::accept(Visitor &v) {
   v.visit(*this);
 }
 
+IndexExprAST::IndexExprAST(const std::string &name, std::unique_ptr<ExprAST> index)
+    : name(name), index(std::move(index)) {}
+
+// accept - accept accepts a visit to visit IndexExprAST
+void IndexExprAST::accept(Visitor &v) {
+  v.visit(*this);
+}
+
 BinaryExprAST::BinaryExprAST(char op, std::unique_ptr<ExprAST> lhs, std::unique_ptr<ExprAST> rhs)
     : op(op), lhs(std::move(lhs)), rhs(std::move(rhs)) {}
 
@@ -32,14 +40,52 @@ void CallExprAST::accept(Visitor &v) {
   v.visit(*this);
 }
 
-PrototypeAST::PrototypeAST(const std::string &name, const std::vector<std::string> &args)
-    : name(name), args(args) {}
+SharedExprAST::SharedExprAST(std::shared_ptr<ExprAST> expr)
+    : expr(std::move(expr)) {}
+
+// accept - accept accepts a visit to visit SharedExprAST
+void SharedExprAST::accept(Visitor &v) {
+  v.visit(*this);
+}
+
+// strip_shared - gets the expression e shares, or e itself if not shared
+ExprAST *strip_shared(ExprAST *e) {
+  auto *shared = dynamic_cast<SharedExprAST *>(e);
+  return shared ? shared->expr.get() : e;
+}
+
+VarExprAST::VarExprAST(std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> vars,
+                       std::unique_ptr<ExprAST> body)
+    : vars(std::move(vars)), body(std::move(body)) {}
+
+// accept - accept accepts a visit to visit VarExprAST
+void VarExprAST::accept(Visitor &v) {
+  v.visit(*this);
+}
+
+ForExprAST::ForExprAST(const std::string &var, std::unique_ptr<ExprAST> start, std::unique_ptr<ExprAST> end,
+                       std::unique_ptr<ExprAST> step, std::unique_ptr<ExprAST> body)
+    : var(var), start(std::move(start)), end(std::move(end)), step(std::move(step)), body(std::move(body)) {}
+
+// accept - accept accepts a visit to visit ForExprAST
+void ForExprAST::accept(Visitor &v) {
+  v.visit(*this);
+}
+
+PrototypeAST::PrototypeAST(const std::string &name, const std::vector<std::string> &args,
+                           const std::vector<bool> &array_args)
+    : name(name), args(args), array_args(array_args) {}
 
 // accept - accept accepts a visit to visit PrototypeAST
 void PrototypeAST::accept(Visitor &v) {
   v.visit(*this);
 }
 
+// is_array_arg - whether the i-th argument is an array
+bool PrototypeAST::is_array_arg(size_t i) const {
+  return i < array_args.size() && array_args[i];
+}
+
 FunctionAST::FunctionAST(std::unique_ptr<PrototypeAST> proto, std::unique_ptr<ExprAST> body)
     : proto(std::move(proto)), body(std::move(body)) {}
 
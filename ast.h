@@ -4,6 +4,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <utility>
 #include <memory>
 #include "lexer.h"
 
@@ -44,6 +45,18 @@ public:
   std::string name;
 };
 
+// IndexExprAST - Expression class for indexing an array, like "a[i]".
+class IndexExprAST : public ExprAST {
+public:
+  IndexExprAST(const std::string &name, std::unique_ptr<ExprAST> index);
+  // accept - accept accepts a visit to visit it
+  void accept(Visitor &v) override;
+
+public:
+  std::string              name;
+  std::unique_ptr<ExprAST> index;
+};
+
 // BinaryExprAST - Expression class for a binary operator.
 class BinaryExprAST : public ExprAST {
 public:
@@ -68,18 +81,68 @@ public:
   std::vector<std::unique_ptr<ExprAST>> args;
 };
 
+// SharedExprAST - Expression class for an occurrence of a pure expression
+// that is shared by all its structurally identical occurrences, making the
+// AST a DAG (see Parser::set_hash_consing).
+class SharedExprAST : public ExprAST {
+public:
+  SharedExprAST(std::shared_ptr<ExprAST> expr);
+  // accept - accept accepts a visit to visit it
+  void accept(Visitor &v) override;
+
+public:
+  std::shared_ptr<ExprAST> expr;
+};
+
+// strip_shared - gets the expression e shares, or e itself if not shared
+ExprAST *strip_shared(ExprAST *e);
+
+// VarExprAST - Expression class for mutable local variables, like
+// "var a = 1, b in a + b", a variable without initializer is 0.
+class VarExprAST : public ExprAST {
+public:
+  VarExprAST(std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> vars,
+             std::unique_ptr<ExprAST> body);
+  // accept - accept accepts a visit to visit it
+  void accept(Visitor &v) override;
+
+public:
+  std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> vars;
+  std::unique_ptr<ExprAST>                                      body;
+};
+
+// ForExprAST - Expression class for loops, like "for i = 0, i < n, 1 in body",
+// the body runs while the end condition is non-zero, the step is 1 if absent,
+// and the loop itself always evaluates to 0.
+class ForExprAST : public ExprAST {
+public:
+  ForExprAST(const std::string &var, std::unique_ptr<ExprAST> start, std::unique_ptr<ExprAST> end,
+             std::unique_ptr<ExprAST> step, std::unique_ptr<ExprAST> body);
+  // accept - accept accepts a visit to visit it
+  void accept(Visitor &v) override;
+
+public:
+  std::string              var;
+  std::unique_ptr<ExprAST> start, end, step, body;
+};
+
 // PrototypeAST - This class represents the "prototype" for a function
 // which captures its name, and its argument names (thus implicitly the number
-// of arguments the funtion takes)
+// of arguments the funtion takes), and which of them are arrays, like "a[]"
 class PrototypeAST : public AST {
 public:
-  PrototypeAST(const std::string &name, const std::vector<std::string> &args);
+  PrototypeAST(const std::string &name, const std::vector<std::string> &args,
+               const std::vector<bool> &array_args = std::vector<bool>());
   // accept - accept accepts a visit to visit it
   void accept(Visitor &v) override;
+  // is_array_arg - whether the i-th argument is an array
+  bool is_array_arg(size_t i) const;
 
 public:
   std::string              name;
   std::vector<std::string> args;
+  std::vector<bool>        array_args;
+  unsigned                 line = 0; // source line of the name, 0 if unknown
 };
 
 // FunctionAST - This class represents a function definition itself.
@@ -102,10 +165,18 @@ public:
   virtual void visit(const NumberExprAST &ast)   = 0;
   // visit - visits VariableExprAST
   virtual void visit(const VariableExprAST &ast) = 0;
+  // visit - visits IndexExprAST
+  virtual void visit(const IndexExprAST &ast)    = 0;
   // visit - visits BinaryExprAST
   virtual void visit(const BinaryExprAST &ast)   = 0;
   // visit - visits CallExprAST
   virtual void visit(const CallExprAST &ast)     = 0;
+  // visit - visits SharedExprAST
+  virtual void visit(const SharedExprAST &ast)   = 0;
+  // visit - visits VarExprAST
+  virtual void visit(const VarExprAST &ast)      = 0;
+  // visit - visits ForExprAST
+  virtual void visit(const ForExprAST &ast)      = 0;
   // visit - visits PrototypeAST
   virtual void visit(const PrototypeAST &ast)    = 0;
   // visit - visits FunctionAST
@@ -1,17 +1,124 @@
+#include <algorithm>
 #include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/Analysis/Passes.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Transforms/Scalar.h>
+#include <llvm/Transforms/Vectorize.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 #include "codegen.h"
+#include "profiler.h"
 
 #define CODEGEN_RETURN_V(v) do { set_ret_value((v)); return; } while(0)
 #define CODEGEN_RETURN_N()  do { set_ret_none(); return; } while(0)
 
-CodeGenerator::CodeGenerator()
+const std::map<std::string, std::pair<llvm::Intrinsic::ID, unsigned>> CodeGenerator::builtins = {
+  #define X(a, b, c) {#a, {llvm::Intrinsic::b, c}},
+  BUILTIN_INFO
+  #undef X
+};
+
+const std::map<std::string, std::pair<std::string, std::string>> CodeGenerator::parallel_builtins = {
+  #define X(a, b, c) {#a, {#b, c}},
+  PARALLEL_BUILTIN_INFO
+  #undef X
+};
+
+// count_instructions - counts instructions of f
+static size_t count_instructions(const llvm::Function &f) {
+  size_t n = 0;
+  for (auto &bb : f) {
+    n += bb.size();
+  }
+  return n;
+}
+
+// veclib_descs - vector variants of builtins, and the target feature each
+// of them needs, see VECLIB_INFO
+static const std::pair<llvm::VecDesc, const char *> veclib_descs[] = {
+  #define X(a, b, c, d) {{a, b, c}, d},
+  VECLIB_INFO
+  #undef X
+};
+
+// load_veclib - loads libmvec, which the vector variants of builtins are
+// resolved in, into the process, returns false if it is not found
+static bool load_veclib() {
+  static const bool loaded = !llvm::sys::DynamicLibrary::LoadLibraryPermanently("libmvec.so.1");
+  return loaded;
+}
+
+CodeGenerator::CodeGenerator(std::ostream &error_stream)
   : the_context(),
     the_module(llvm::make_unique<llvm::Module>("sole_module", the_context)),
     ir_builder(the_context),
-    named_values() {}
+    named_values(),
+    the_fpm(),
+    error_stream(error_stream) {
+  create_fpm(nullptr);
+}
 
-// visit - generates codes for NumberAST
+// create_fpm - creates the function pass manager, which uses the cost model
+// of tm if not nullptr
+void CodeGenerator::create_fpm(llvm::TargetMachine *tm) {
+  the_fpm = llvm::make_unique<llvm::legacy::FunctionPassManager>(the_module.get());
+  // the vectorizer only finds vector registers via the target's cost model
+  if (tm) {
+    the_fpm->add(llvm::createTargetTransformInfoWrapperPass(tm->getTargetIRAnalysis()));
+  }
+  // tell the vectorizer which vector functions builtins can be widened to,
+  // only when codes are compiled for tm to run in this process, which then
+  // resolves them in libmvec
+  llvm::TargetLibraryInfoImpl tlii(llvm::Triple(llvm::sys::getProcessTriple()));
+  if (tm && llvm::Triple::x86_64 == tm->getTargetTriple().getArch() && load_veclib()) {
+    std::string features = tm->getTargetFeatureString().str();
+    std::vector<llvm::VecDesc> descs;
+    for (auto &desc : veclib_descs) {
+      if (std::string::npos != features.find(desc.second)) {
+        descs.push_back(desc.first);
+      }
+    }
+    tlii.addVectorizableFunctions(descs);
+  }
+  the_fpm->add(new llvm::TargetLibraryInfoWrapperPass(tlii));
+  // promote stack slots of mutable variables to registers
+  the_fpm->add(llvm::createPromoteMemoryToRegisterPass());
+  // do simple "peephole" optimizations, builtins are constant folded here
+  the_fpm->add(llvm::createInstructionCombiningPass());
+  // reassociate expressions
+  the_fpm->add(llvm::createReassociatePass());
+  // eliminate common sub-expressions
+  the_fpm->add(llvm::createGVNPass());
+  // simplify the control flow graph
+  the_fpm->add(llvm::createCFGSimplificationPass());
+  // hoist loop invariants, and bounds checks proven by loop bounds
+  the_fpm->add(llvm::createLoopRotatePass());
+  the_fpm->add(llvm::createLICMPass());
+  the_fpm->add(llvm::createIndVarSimplifyPass());
+  the_fpm->add(llvm::createInductiveRangeCheckEliminationPass());
+  // unroll and vectorize loops, then clean up
+  the_fpm->add(llvm::createLoopUnrollPass());
+  the_fpm->add(llvm::createLoopVectorizePass());
+  the_fpm->add(llvm::createInstructionCombiningPass());
+  the_fpm->add(llvm::createCFGSimplificationPass());
+  the_fpm->doInitialization();
+}
+
+// set_target_machine - generates codes for tm, which also enables the
+// target's cost model in optimizations, e.g. vectorization
+void CodeGenerator::set_target_machine(llvm::TargetMachine *tm) {
+  the_module->setTargetTriple(tm->getTargetTriple().str());
+  create_fpm(tm);
+}
+
+// visit - generates codes for NumberAST, an integral number is an i64
 void CodeGenerator::visit(const NumberExprAST &ast) {
+  if (TypeInferer::is_integral(ast.val)) {
+    CODEGEN_RETURN_V(llvm::ConstantInt::get(llvm::Type::getInt64Ty(the_context), static_cast<int64_t>(ast.val), true));
+  }
   CODEGEN_RETURN_V(llvm::ConstantFP::get(the_context, llvm::APFloat(ast.val)));
 }
 
@@ -19,15 +126,38 @@ void CodeGenerator::visit(const NumberExprAST &ast) {
 void CodeGenerator::visit(const VariableExprAST &ast) {
   auto v = named_values.find(ast.name);
   if (named_values.end() == v) {
-    throw_error_v("unknown variable name");
+    if (named_arrays.count(ast.name)) {
+      throw_error_v("array cannot be used as a number");
+    } else {
+      throw_error_v("unknown variable name");
+    }
     CODEGEN_RETURN_N();
   }
 
-  CODEGEN_RETURN_V(v->second);
+  CODEGEN_RETURN_V(ir_builder.CreateLoad(v->second, ast.name));
+}
+
+// visit - generates codes for IndexExprAST
+void CodeGenerator::visit(const IndexExprAST &ast) {
+  llvm::Value *elem = gen_elem_ptr(ast);
+  if (!elem) {
+    CODEGEN_RETURN_N();
+  }
+
+  CODEGEN_RETURN_V(ir_builder.CreateLoad(elem, "elemtmp"));
 }
 
 // visit - generates codes for BinaryExprAST
 void CodeGenerator::visit(const BinaryExprAST &ast) {
+  // the lhs of an assignment is a destination rather than a value
+  if (Lexer::operator_assign == ast.op) {
+    llvm::Value *v = gen_assign(ast);
+    if (!v) {
+      CODEGEN_RETURN_N();
+    }
+    CODEGEN_RETURN_V(v);
+  }
+
   // generates codes for lhs and rhs
   ast.lhs->accept(*this);
   llvm::Value *l = get_ret_v();
@@ -41,57 +171,287 @@ void CodeGenerator::visit(const BinaryExprAST &ast) {
     CODEGEN_RETURN_N();
   }
 
-  // generates codes for the binop
-  switch (ast.op) {
-  case Lexer::operator_lt:
-    l = ir_builder.CreateFCmpULT(l, r, "cmptmp");
-    CODEGEN_RETURN_V(ir_builder.CreateUIToFP(l, llvm::Type::getDoubleTy(the_context), "booltmp"));
-  case Lexer::operator_sub:
-    CODEGEN_RETURN_V(ir_builder.CreateFSub(l, r, "subtmp"));
-  case Lexer::operator_add:
-    CODEGEN_RETURN_V(ir_builder.CreateFAdd(l, r, "addtmp"));
-  case Lexer::operator_mul:
-    CODEGEN_RETURN_V(ir_builder.CreateFMul(l, r, "multmp"));
-  default:
-    throw_error_v("invalid binary operator");
+  if (Lexer::operator_seq == ast.op) {
+    CODEGEN_RETURN_V(r);
+  }
+
+  llvm::Value *v = gen_binop(ast.op, l, r, type_inferer.get_expr_type(&ast));
+  if (!v) {
     CODEGEN_RETURN_N();
   }
+  CODEGEN_RETURN_V(v);
 }
 
+// visit - generates codes for CallExprAST
 void CodeGenerator::visit(const CallExprAST &ast) {
-  // look up the name in the global module table
+  // look up the name in the global module table, a builtin is preferred
+  // unless it is redefined (via "def")
   llvm::Function *callee_ref = the_module->getFunction(ast.callee);
+  if (!callee_ref || callee_ref->empty()) {
+    // len(a) - the length of array a
+    if ("len" == ast.callee) {
+      auto *array = 1 == ast.args.size() ? dynamic_cast<VariableExprAST *>(strip_shared(ast.args[0].get())) : nullptr;
+      auto a = array ? named_arrays.find(array->name) : named_arrays.end();
+      if (named_arrays.end() == a) {
+        throw_error_v("expected an array as the argument of len");
+        CODEGEN_RETURN_N();
+      }
+      CODEGEN_RETURN_V(a->second.second);
+    }
+    auto p = parallel_builtins.find(ast.callee);
+    if (parallel_builtins.end() != p) {
+      llvm::Value *v = gen_parallel_builtin(ast, p->second.first, p->second.second);
+      if (!v) {
+        CODEGEN_RETURN_N();
+      }
+      CODEGEN_RETURN_V(v);
+    }
+    // the arity of a builtin is checked against BUILTIN_INFO
+    auto b = builtins.find(ast.callee);
+    if (builtins.end() != b && b->second.second != ast.args.size()) {
+      throw_error_v("incorrect # arguments passed to builtin " + ast.callee);
+      CODEGEN_RETURN_N();
+    }
+    if (llvm::Function *builtin = get_builtin(ast.callee)) {
+      callee_ref = builtin;
+    }
+  }
   if (!callee_ref) {
     throw_error_v("unknown function referenced");
     CODEGEN_RETURN_N();
   }
 
-  // if argument mismatch error
-  if (callee_ref->arg_size() != ast.args.size()) {
+  // if argument mismatch error, each array takes two llvm arguments
+  size_t n_args = callee_ref->arg_size();
+  for (auto &arg : callee_ref->args()) {
+    n_args -= arg.getType()->isPointerTy() ? 1 : 0;
+  }
+  if (n_args != ast.args.size()) {
     throw_error_v("incorrect # arguments passed");
     CODEGEN_RETURN_N();
   }
 
-  // generates codes for each arg
+  // generates codes for each arg, recording the literal ones
   std::vector<llvm::Value *> args;
+  SpecializationKey key(ast.callee, {});
   for (unsigned i = 0, e = static_cast<unsigned>(ast.args.size()); i < e; i ++) {
-    ast.args[i]->accept(*this);
-    auto v = get_ret_v();
-    if (!v) {
+    if (auto *number = dynamic_cast<NumberExprAST *>(strip_shared(ast.args[i].get()))) {
+      key.second.push_back(std::make_pair(static_cast<unsigned>(args.size()), number->val));
+    }
+    if (!gen_arg(*ast.args[i], args)) {
+      CODEGEN_RETURN_N();
+    }
+  }
+
+  // if an array is passed as a number, or vice versa
+  llvm::FunctionType *ft = callee_ref->getFunctionType();
+  for (unsigned i = 0, e = static_cast<unsigned>(args.size()); i < e; i ++) {
+    if (e != ft->getNumParams() || args[i]->getType() != ft->getParamType(i)) {
+      throw_error_v("array argument mismatch");
+      CODEGEN_RETURN_N();
+    }
+  }
+
+  // calls the specialization on the literal args instead, if it pays off
+  if (specializing && !key.second.empty()) {
+    if (llvm::Function *spec = get_specialization(callee_ref, key)) {
+      std::vector<llvm::Value *> rest;
+      auto bound = key.second.begin();
+      for (unsigned i = 0, e = static_cast<unsigned>(args.size()); i < e; i ++) {
+        if (key.second.end() != bound && bound->first == i) {
+          ++ bound;
+        } else {
+          rest.push_back(args[i]);
+        }
+      }
+      callee_ref = spec;
+      args.swap(rest);
+    }
+  }
+
+  // generates codes for call, a call other than to a builtin may change arrays.
+  // a function named like a library one, e.g. a redefined sqrt, is not the
+  // library function to the optimizer
+  llvm::CallInst *v = ir_builder.CreateCall(callee_ref, args, "calltmp");
+  if (!callee_ref->isIntrinsic()) {
+    v->addAttribute(llvm::AttributeSet::FunctionIndex, llvm::Attribute::NoBuiltin);
+    shared_values.clear();
+  }
+  CODEGEN_RETURN_V(v);
+}
+
+// visit - generates codes for SharedExprAST, reusing the value generated
+// for an earlier occurrence if it is still valid
+void CodeGenerator::visit(const SharedExprAST &ast) {
+  // values in other blocks may not dominate this one
+  if (ir_builder.GetInsertBlock() != shared_block) {
+    shared_values.clear();
+    shared_block = ir_builder.GetInsertBlock();
+  }
+
+  auto shared = shared_values.find(ast.expr.get());
+  if (shared_values.end() != shared) {
+    CODEGEN_RETURN_V(shared->second);
+  }
+
+  ast.expr->accept(*this);
+  llvm::Value *v = get_ret_v();
+  if (!v) {
+    CODEGEN_RETURN_N();
+  }
+
+  if (ir_builder.GetInsertBlock() == shared_block) {
+    shared_values[ast.expr.get()] = v;
+  }
+  CODEGEN_RETURN_V(v);
+}
+
+// visit - generates codes for VarExprAST
+void CodeGenerator::visit(const VarExprAST &ast) {
+  llvm::Function *f = ir_builder.GetInsertBlock()->getParent();
+
+  // variables shadow existing ones with the same names until the body ends
+  std::vector<std::pair<std::string, llvm::AllocaInst *>> shadowed;
+  auto restore = [this, &shadowed]() {
+    shared_values.clear();
+    for (auto v = shadowed.rbegin(); v != shadowed.rend(); ++ v) {
+      if (v->second) {
+        named_values[v->first] = v->second;
+      } else {
+        named_values.erase(v->first);
+      }
+    }
+  };
+
+  for (auto &var : ast.vars) {
+    // the initializer is generated before the variable is in scope
+    llvm::Type *ty = get_llvm_type(type_inferer.get_var_type(&var));
+    llvm::Value *init = llvm::Constant::getNullValue(ty);
+    if (var.second) {
+      var.second->accept(*this);
+      if (!(init = get_ret_v())) {
+        restore();
+        CODEGEN_RETURN_N();
+      }
+    }
+
+    if (!(init = gen_cast(init, ty))) {
+      restore();
       CODEGEN_RETURN_N();
+    }
+    llvm::AllocaInst *slot = create_entry_alloca(f, var.first, ty);
+    ir_builder.CreateStore(init, slot);
+    shared_values.clear();
+
+    auto old = named_values.find(var.first);
+    shadowed.push_back(std::make_pair(var.first, named_values.end() == old ? nullptr : old->second));
+    named_values[var.first] = slot;
+  }
+
+  ast.body->accept(*this);
+  llvm::Value *body = get_ret_v();
+  restore();
+
+  if (!body) {
+    CODEGEN_RETURN_N();
+  }
+  CODEGEN_RETURN_V(body);
+}
+
+// visit - generates codes for ForExprAST
+void CodeGenerator::visit(const ForExprAST &ast) {
+  llvm::Function *f = ir_builder.GetInsertBlock()->getParent();
+
+  // the start value is generated before the loop variable is in scope
+  ast.start->accept(*this);
+  llvm::Value *start = get_ret_v();
+  if (!start) {
+    CODEGEN_RETURN_N();
+  }
+
+  llvm::Type *ty = get_llvm_type(type_inferer.get_var_type(&ast));
+  if (!(start = gen_cast(start, ty))) {
+    CODEGEN_RETURN_N();
+  }
+  llvm::AllocaInst *slot = create_entry_alloca(f, ast.var, ty);
+  ir_builder.CreateStore(start, slot);
+  shared_values.clear();
+
+  // the loop variable shadows an existing variable with the same name
+  auto old = named_values.find(ast.var);
+  llvm::AllocaInst *shadowed = named_values.end() == old ? nullptr : old->second;
+  named_values[ast.var] = slot;
+  auto restore = [this, &ast, shadowed]() {
+    shared_values.clear();
+    if (shadowed) {
+      named_values[ast.var] = shadowed;
     } else {
-      args.push_back(v);
+      named_values.erase(ast.var);
     }
+  };
+
+  llvm::BasicBlock *cond_bb  = llvm::BasicBlock::Create(the_context, "loopcond", f);
+  llvm::BasicBlock *body_bb  = llvm::BasicBlock::Create(the_context, "loop", f);
+  llvm::BasicBlock *after_bb = llvm::BasicBlock::Create(the_context, "afterloop", f);
+
+  // loopcond: runs the body while the end condition is non-zero
+  ir_builder.CreateBr(cond_bb);
+  ir_builder.SetInsertPoint(cond_bb);
+  ast.end->accept(*this);
+  llvm::Value *end = get_ret_v();
+  if (!end) {
+    restore();
+    CODEGEN_RETURN_N();
+  }
+  end = gen_cond(end);
+  ir_builder.CreateCondBr(end, body_bb, after_bb);
+
+  // loop: the body, then the step
+  ir_builder.SetInsertPoint(body_bb);
+  ast.body->accept(*this);
+  if (!get_ret_v()) {
+    restore();
+    CODEGEN_RETURN_N();
   }
 
-  // generates codes for call
-  CODEGEN_RETURN_V(ir_builder.CreateCall(callee_ref, args, "calltmp"));
+  llvm::Value *step = llvm::ConstantInt::get(llvm::Type::getInt64Ty(the_context), 1);
+  if (ast.step) {
+    ast.step->accept(*this);
+    if (!(step = get_ret_v())) {
+      restore();
+      CODEGEN_RETURN_N();
+    }
+  }
+  llvm::Value *curr = ir_builder.CreateLoad(slot, ast.var);
+  int type = ty->isIntegerTy() ? TypeInferer::TYPE_INT : TypeInferer::TYPE_DOUBLE;
+  llvm::Value *next = gen_binop(Lexer::operator_add, curr, step, type, "nextvar");
+  if (!next || !(next = gen_cast(next, ty))) {
+    restore();
+    CODEGEN_RETURN_N();
+  }
+  ir_builder.CreateStore(next, slot);
+  ir_builder.CreateBr(cond_bb);
+
+  // afterloop
+  ir_builder.SetInsertPoint(after_bb);
+  restore();
+
+  CODEGEN_RETURN_V(llvm::ConstantFP::get(the_context, llvm::APFloat(0.0)));
 }
 
 // visit - generates codes for PrototypeAST
 void CodeGenerator::visit(const PrototypeAST &ast) {
-  // make type for the args, in Kaleioscope, they are all double
-  std::vector<llvm::Type *> arg_types(ast.args.size(), llvm::Type::getDoubleTy(the_context));
+  // make type for the args, in Kaleioscope, they are all double, except
+  // that an array is passed as a (double *, i64) pair of its data and length
+  std::vector<llvm::Type *> arg_types;
+  for (size_t i = 0; i < ast.args.size(); i ++) {
+    if (ast.is_array_arg(i)) {
+      arg_types.push_back(llvm::Type::getDoublePtrTy(the_context));
+      arg_types.push_back(llvm::Type::getInt64Ty(the_context));
+    } else {
+      arg_types.push_back(llvm::Type::getDoubleTy(the_context));
+    }
+  }
   llvm::Type *ret_type = llvm::Type::getDoubleTy(the_context);
 
   // make type for the function
@@ -100,9 +460,12 @@ void CodeGenerator::visit(const PrototypeAST &ast) {
   // create a function
   llvm::Function *f = llvm::Function::Create(ft, llvm::Function::ExternalLinkage, ast.name, the_module.get());
 
-  unsigned idx = 0;
-  for (auto &arg : f->args()) {
-    arg.setName(ast.args[idx ++]);
+  auto arg = f->arg_begin();
+  for (size_t i = 0; i < ast.args.size(); i ++) {
+    (arg ++)->setName(ast.args[i]);
+    if (ast.is_array_arg(i)) {
+      (arg ++)->setName(ast.args[i] + ".len");
+    }
   }
 
   CODEGEN_RETURN_V(f);
@@ -112,14 +475,36 @@ void CodeGenerator::visit(const PrototypeAST &ast) {
 void CodeGenerator::visit(const FunctionAST &ast) {
   // check the symbol table
   llvm::Function *f = the_module->getFunction(ast.proto->name);
+  // old is the definition replaced, which keeps its body until the new one
+  // is generated
+  llvm::Function *old = nullptr;
+  // specializations created from here on are only called by f
+  size_t n_specializations = new_specializations.size();
 
-  if (f && !f->empty()) { // find f, and f is already defined (via "def")
+  if (f && !f->empty() && redefinable) { // find f, and f is to be redefined
+    old = f;
+    old->setName(ast.proto->name + ".old");
+    ast.proto->accept(*this); // we declare the new one
+    if (!(f = get_ret_f())) {
+      old->setName(ast.proto->name);
+      CODEGEN_RETURN_N();
+    }
+  } else if (f && !f->empty()) { // find f, and f is already defined (via "def")
     throw_error_v("function cannot be redefined");
     CODEGEN_RETURN_N();
   } else if (f && f->empty()) { // find f, and f is declared (via "extern")
+    std::vector<std::string> names;
+    for (size_t i = 0; i < ast.proto->args.size(); i ++) {
+      names.push_back(ast.proto->args[i]);
+      if (ast.proto->is_array_arg(i)) {
+        names.push_back(ast.proto->args[i] + ".len");
+      }
+    }
+
     unsigned idx = 0;
+    bool same = names.size() == f->arg_size();
     for (auto &arg : f->args()) {
-      if (ast.proto->args[idx ++] != arg.getName()) {
+      if (!same || names[idx ++] != arg.getName()) {
         throw_error_v("argument name is not the same as the declaration");
         CODEGEN_RETURN_N();
       }
@@ -137,27 +522,68 @@ void CodeGenerator::visit(const FunctionAST &ast) {
   llvm::BasicBlock *bb = llvm::BasicBlock::Create(the_context, "entry", f);
   ir_builder.SetInsertPoint(bb);
 
-  // record the function arguments in the named_values map
+  // record the function arguments in the named_values map, and the array
+  // arguments in the named_arrays map
   named_values.clear();
-  for (auto &arg : f->args()) {
-    named_values[arg.getName()] = &arg;
+  named_arrays.clear();
+  checked_indices.clear();
+  checked_block     = nullptr;
+  bounds_fail_block = nullptr;
+  shared_values.clear();
+  shared_block      = nullptr;
+  for (auto arg = f->arg_begin(), e = f->arg_end(); arg != e; ++ arg) {
+    if (arg->getType()->isPointerTy()) {
+      llvm::Value *data = &*arg ++;
+      named_arrays[data->getName().str()] = std::make_pair(data, &*arg);
+    } else {
+      // arguments are mutable, so each is stored in a stack slot
+      llvm::AllocaInst *slot = create_entry_alloca(f, arg->getName().str(), arg->getType());
+      ir_builder.CreateStore(&*arg, slot);
+      named_values[arg->getName().str()] = slot;
+    }
+  }
+
+  // infers which variables can be kept as integers or booleans
+  llvm::Function *len = the_module->getFunction("len");
+  type_inferer.infer(ast, !len || len->empty());
+
+  // a profiled function records its entry and each exit
+  llvm::Value *profile_id = nullptr;
+  if (profiling && !ast.proto->name.empty()) {
+    profile_id = llvm::ConstantInt::get(llvm::Type::getInt64Ty(the_context), Profiler::get_instance().get_id(ast.proto->name));
+    gen_profile_call("klang_prof_enter", profile_id);
   }
 
   ast.body->accept(*this);
   if (llvm::Value *ret_value = get_ret_v()) {
-    // finish off the function
-    ir_builder.CreateRet(ret_value);
+    // finish off the function, which returns a double
+    if (profile_id) {
+      gen_profile_call("klang_prof_exit", profile_id);
+    }
+    ir_builder.CreateRet(gen_cast(ret_value, llvm::Type::getDoubleTy(the_context)));
 
     // validate the generated code, checking for consistency
     llvm::verifyFunction(*f);
 
+    // optimize the function
+    the_fpm->run(*f);
+
+    if (old) {
+      retire(old, f);
+    }
+
     CODEGEN_RETURN_V(f);
 
     return ;
   }
 
-  // error reading body, remove function for redefinition
+  // error reading body, remove function for redefinition, and the
+  // specializations created for it
   f->eraseFromParent();
+  discard_specializations(n_specializations);
+  if (old) {
+    old->setName(ast.proto->name);
+  }
 
   CODEGEN_RETURN_N();
 }
@@ -195,7 +621,522 @@ void CodeGenerator::set_ret_value(llvm::Value *v) {
   ret_v = v;
 }
 
+// get_context - gets the context that codes are generated in
+llvm::LLVMContext &CodeGenerator::get_context() {
+  return the_context;
+}
+
+// get_module - gets the module that codes are generated into
+const llvm::Module &CodeGenerator::get_module() const {
+  return *the_module;
+}
+
+// get_builtin - gets the intrinsic that builtin name is lowered to, or nullptr
+llvm::Function *CodeGenerator::get_builtin(const std::string &name) {
+  auto b = builtins.find(name);
+  if (builtins.end() == b) {
+    return nullptr;
+  }
+
+  // all builtins are overloaded on double
+  llvm::Type *ty = llvm::Type::getDoubleTy(the_context);
+  return llvm::Intrinsic::getDeclaration(the_module.get(), b->second.first, ty);
+}
+
+// create_entry_alloca - creates a stack slot of type ty of a mutable variable
+// in the entry block of f, which mem2reg promotes to registers
+llvm::AllocaInst *CodeGenerator::create_entry_alloca(llvm::Function *f, const std::string &name, llvm::Type *ty) {
+  llvm::IRBuilder<> entry_builder(&f->getEntryBlock(), f->getEntryBlock().begin());
+  return entry_builder.CreateAlloca(ty, nullptr, name);
+}
+
+// get_llvm_type - gets the llvm type of a TypeInferer type
+llvm::Type *CodeGenerator::get_llvm_type(int type) {
+  switch (type) {
+  case TypeInferer::TYPE_BOOL: return llvm::Type::getInt1Ty(the_context);
+  case TypeInferer::TYPE_INT:  return llvm::Type::getInt64Ty(the_context);
+  default:                     return llvm::Type::getDoubleTy(the_context);
+  }
+}
+
+// gen_cast - generates codes converting v to ty, only ever widening it, i.e.
+// i1 to i64 and i1 or i64 to double, returns nullptr if ty is narrower
+llvm::Value *CodeGenerator::gen_cast(llvm::Value *v, llvm::Type *ty) {
+  if (v->getType() == ty) {
+    return v;
+  }
+  if (ty->isDoubleTy()) {
+    return v->getType()->isIntegerTy(1) ? ir_builder.CreateUIToFP(v, ty, "booltmp") : ir_builder.CreateSIToFP(v, ty, "inttmp");
+  }
+  if (!v->getType()->isIntegerTy() || v->getType()->getIntegerBitWidth() > ty->getIntegerBitWidth()) {
+    throw_error_v("value inferred of a narrower type than it has");
+    return nullptr;
+  }
+  return ir_builder.CreateZExt(v, ty, "booltmp");
+}
+
+// gen_cond - generates codes for checking that the condition v is non-zero
+llvm::Value *CodeGenerator::gen_cond(llvm::Value *v) {
+  if (v->getType()->isIntegerTy(1)) {
+    return v;
+  }
+  if (v->getType()->isIntegerTy()) {
+    return ir_builder.CreateICmpNE(v, llvm::ConstantInt::get(v->getType(), 0), "condtmp");
+  }
+  return ir_builder.CreateFCmpONE(v, llvm::ConstantFP::get(the_context, llvm::APFloat(0.0)), "condtmp");
+}
+
+// gen_binop - generates codes for an arithmetic or comparison binop whose
+// result is inferred of type, on integers if both l and r are integers or
+// booleans and the result is not a double, otherwise on doubles. the type
+// inferer only infers an integer result whose bounds are within 2^53, so
+// the integer operation never wraps, and gives what the double one would
+llvm::Value *CodeGenerator::gen_binop(char op, llvm::Value *l, llvm::Value *r, int type, const std::string &name) {
+  if (l->getType()->isIntegerTy() && r->getType()->isIntegerTy() && TypeInferer::TYPE_DOUBLE != type) {
+    llvm::Type *ty = llvm::Type::getInt64Ty(the_context);
+    l = gen_cast(l, ty);
+    r = gen_cast(r, ty);
+    switch (op) {
+    case Lexer::operator_lt:  return ir_builder.CreateICmpSLT(l, r, "cmptmp");
+    case Lexer::operator_sub: return ir_builder.CreateSub(l, r, name.empty() ? "subtmp" : name);
+    case Lexer::operator_add: return ir_builder.CreateAdd(l, r, name.empty() ? "addtmp" : name);
+    case Lexer::operator_mul: return ir_builder.CreateMul(l, r, name.empty() ? "multmp" : name);
+    default: break;
+    }
+  } else {
+    llvm::Type *ty = llvm::Type::getDoubleTy(the_context);
+    l = gen_cast(l, ty);
+    r = gen_cast(r, ty);
+    switch (op) {
+    case Lexer::operator_lt:  return ir_builder.CreateFCmpULT(l, r, "cmptmp");
+    case Lexer::operator_sub: return ir_builder.CreateFSub(l, r, name.empty() ? "subtmp" : name);
+    case Lexer::operator_add: return ir_builder.CreateFAdd(l, r, name.empty() ? "addtmp" : name);
+    case Lexer::operator_mul: return ir_builder.CreateFMul(l, r, name.empty() ? "multmp" : name);
+    default: break;
+    }
+  }
+
+  throw_error_v("invalid binary operator");
+  return nullptr;
+}
+
+// gen_assign - generates codes for an assignment "lhs = rhs"
+llvm::Value *CodeGenerator::gen_assign(const BinaryExprAST &ast) {
+  ast.rhs->accept(*this);
+  llvm::Value *v = get_ret_v();
+  if (!v) {
+    return nullptr;
+  }
+
+  ExprAST *lhs = strip_shared(ast.lhs.get());
+  if (auto *var = dynamic_cast<VariableExprAST *>(lhs)) {
+    auto slot = named_values.find(var->name);
+    if (named_values.end() == slot) {
+      throw_error_v(named_arrays.count(var->name) ? "array cannot be assigned" : "unknown variable name");
+      return nullptr;
+    }
+    // the assignment evaluates to the value as stored
+    if (!(v = gen_cast(v, slot->second->getAllocatedType()))) {
+      return nullptr;
+    }
+    ir_builder.CreateStore(v, slot->second);
+    shared_values.clear();
+    return v;
+  }
+
+  if (auto *index = dynamic_cast<IndexExprAST *>(lhs)) {
+    llvm::Value *elem = gen_elem_ptr(*index);
+    if (!elem) {
+      return nullptr;
+    }
+    v = gen_cast(v, llvm::Type::getDoubleTy(the_context));
+    ir_builder.CreateStore(v, elem);
+    shared_values.clear();
+    return v;
+  }
+
+  throw_error_v("destination of '=' must be a variable or an array element");
+  return nullptr;
+}
+
+// gen_elem_ptr - generates codes for the address of an array element
+llvm::Value *CodeGenerator::gen_elem_ptr(const IndexExprAST &ast) {
+  auto a = named_arrays.find(ast.name);
+  if (named_arrays.end() == a) {
+    throw_error_v("unknown array name");
+    return nullptr;
+  }
+
+  ast.index->accept(*this);
+  llvm::Value *key = get_ret_v();
+  if (!key) {
+    return nullptr;
+  }
+
+  gen_bounds_check(ast.name, a->second.second, key);
+
+  // an integer index is used as it is, a double one is truncated, which the
+  // check makes safe
+  llvm::Type  *i64   = llvm::Type::getInt64Ty(the_context);
+  llvm::Value *index = key->getType()->isDoubleTy() ? ir_builder.CreateFPToSI(key, i64, "idxtmp") : gen_cast(key, i64);
+
+  return ir_builder.CreateGEP(a->second.first, index, "elemptr");
+}
+
+// get_specialization - gets the clone of callee with the args in key bound
+// to their constants, or nullptr if the generic callee should be called
+llvm::Function *CodeGenerator::get_specialization(llvm::Function *callee, const SpecializationKey &key) {
+  // the body of a function being generated is not complete yet
+  if (callee->empty() || callee->isIntrinsic() || callee == ir_builder.GetInsertBlock()->getParent()) {
+    return nullptr;
+  }
+
+  auto s = specializations.find(key);
+  if (specializations.end() != s) {
+    return s->second;
+  }
+
+  llvm::Function *spec = create_specialization(callee, key);
+  if (spec) {
+    new_specializations.push_back(spec);
+  }
+  specializations[key] = spec;
+  return spec;
+}
+
+// create_specialization - creates the clone of callee with the args in key
+// bound to their constants, or nullptr if it does not pay off
+llvm::Function *CodeGenerator::create_specialization(llvm::Function *callee, const SpecializationKey &key) {
+  // a clone of a function still calling a retired one would call it by its
+  // retired name, under which it was never compiled
+  if (calls_retired(*callee)) {
+    return nullptr;
+  }
+
+  llvm::ValueToValueMapTy vmap;
+  std::vector<llvm::Argument *> params;
+  for (auto &arg : callee->args()) {
+    params.push_back(&arg);
+  }
+  for (auto &bound : key.second) {
+    vmap[params[bound.first]] = llvm::ConstantFP::get(the_context, llvm::APFloat(bound.second));
+  }
+
+  llvm::Function *spec = llvm::CloneFunction(callee, vmap, false);
+  spec->setName(callee->getName() + ".spec");
+  the_module->getFunctionList().push_back(spec);
+  the_fpm->run(*spec);
+
+  // a specialization pays off if constants folded away some instructions or
+  // some control flow, e.g. a loop of a constant trip count is unrolled
+  if (count_instructions(*spec) < count_instructions(*callee) || spec->size() < callee->size()) {
+    return spec;
+  }
+  spec->eraseFromParent();
+  return nullptr;
+}
+
+// create_forwarder - creates a function of the type of the specialization of
+// callee for key, which calls callee with the args in key bound
+llvm::Function *CodeGenerator::create_forwarder(llvm::Function *callee, const SpecializationKey &key) {
+  std::vector<llvm::Type *> arg_types;
+  auto bound = key.second.begin();
+  unsigned idx = 0;
+  for (auto &arg : callee->args()) {
+    if (key.second.end() != bound && bound->first == idx) {
+      ++ bound;
+    } else {
+      arg_types.push_back(arg.getType());
+    }
+    idx ++;
+  }
+  llvm::FunctionType *ft = llvm::FunctionType::get(callee->getReturnType(), arg_types, false);
+  llvm::Function *spec = llvm::Function::Create(ft, llvm::Function::ExternalLinkage, callee->getName() + ".spec", the_module.get());
+
+  llvm::IRBuilder<> builder(llvm::BasicBlock::Create(the_context, "entry", spec));
+  std::vector<llvm::Value *> args;
+  auto spec_arg = spec->arg_begin();
+  bound = key.second.begin();
+  for (unsigned i = 0, e = static_cast<unsigned>(callee->arg_size()); i < e; i ++) {
+    if (key.second.end() != bound && bound->first == i) {
+      args.push_back(llvm::ConstantFP::get(the_context, llvm::APFloat(bound->second)));
+      ++ bound;
+    } else {
+      args.push_back(&*spec_arg ++);
+    }
+  }
+  builder.CreateRet(builder.CreateCall(callee, args, "calltmp"));
+  return spec;
+}
+
+// retire - retires old, which f redefines, old and its specializations are
+// erased once nothing calls them any more
+void CodeGenerator::retire(llvm::Function *old, llvm::Function *f) {
+  // callers of old call f instead, unless the types differ, in which case
+  // the callers must be generated again
+  if (old->getType() == f->getType()) {
+    old->replaceAllUsesWith(f);
+  }
+  retired.push_back(old);
+
+  // a specialization already called is specialized again, or replaced by a
+  // forwarder to f if that does not pay off any more, so its callers call
+  // the new definition too. the others are forgotten
+  for (auto s = specializations.begin(); s != specializations.end(); ) {
+    if (s->first.first != f->getName()) {
+      ++ s;
+      continue;
+    }
+
+    llvm::Function *spec = s->second;
+    if (!spec) {
+      s = specializations.erase(s);
+      continue;
+    }
+    retired.push_back(spec);
+    if (old->getType() != f->getType()) {
+      s = specializations.erase(s);
+      continue;
+    }
+
+    llvm::Function *respec = create_specialization(f, s->first);
+    if (!respec) {
+      respec = create_forwarder(f, s->first);
+    }
+    respec->takeName(spec);
+    spec->replaceAllUsesWith(respec);
+    new_specializations.push_back(respec);
+    s->second = respec;
+    ++ s;
+  }
+
+  // erasing a function may leave another unused
+  for (bool erased = true; erased; ) {
+    erased = false;
+    for (auto r = retired.begin(); r != retired.end(); ) {
+      if ((*r)->use_empty()) {
+        (*r)->eraseFromParent();
+        r = retired.erase(r);
+        erased = true;
+      } else {
+        ++ r;
+      }
+    }
+  }
+}
+
+// calls_retired - checks whether f calls a retired function, or passes one
+// to a parallel builtin
+bool CodeGenerator::calls_retired(const llvm::Function &f) {
+  for (auto &bb : f) {
+    for (auto &inst : bb) {
+      for (auto &op : inst.operands()) {
+        auto *callee = llvm::dyn_cast<llvm::Function>(op);
+        if (callee && retired.end() != std::find(retired.begin(), retired.end(), callee)) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+// set_redefinable - allows defining a function again, the old definition is
+// replaced in the module once the new one is generated
+void CodeGenerator::set_redefinable(bool redefinable) {
+  this->redefinable = redefinable;
+}
+
+// set_profiling - instruments the entry and exit of each named function
+// defined later for the profiler
+void CodeGenerator::set_profiling(bool profiling) {
+  this->profiling = profiling;
+}
+
+// set_specializing - enables or disables calling specializations of callees
+// on literal args, which depend on the bodies of the callees
+void CodeGenerator::set_specializing(bool specializing) {
+  this->specializing = specializing;
+}
+
+// take_specializations - takes the specializations created since the last call
+std::vector<llvm::Function *> CodeGenerator::take_specializations() {
+  std::vector<llvm::Function *> specs;
+  specs.swap(new_specializations);
+  return specs;
+}
+
+// discard_specializations - erases the specializations created since there
+// were n of them, which nothing calls
+void CodeGenerator::discard_specializations(size_t n) {
+  for (size_t i = n; i < new_specializations.size(); i ++) {
+    llvm::Function *spec = new_specializations[i];
+    for (auto s = specializations.begin(); s != specializations.end(); ) {
+      if (s->second == spec) {
+        s = specializations.erase(s);
+      } else {
+        ++ s;
+      }
+    }
+    spec->eraseFromParent();
+  }
+  new_specializations.resize(n);
+}
+
+// gen_arg - generates codes for an arg of a call, an array is passed as
+// its (data, length) pair, returns false if failed
+bool CodeGenerator::gen_arg(ExprAST &ast, std::vector<llvm::Value *> &values) {
+  // a variable shadows an array with the same name
+  auto *var = dynamic_cast<VariableExprAST *>(strip_shared(&ast));
+  auto a = var && !named_values.count(var->name) ? named_arrays.find(var->name) : named_arrays.end();
+  if (named_arrays.end() != a) {
+    values.push_back(a->second.first);
+    values.push_back(a->second.second);
+    return true;
+  }
+
+  ast.accept(*this);
+  llvm::Value *v = get_ret_v();
+  if (!v) {
+    return false;
+  }
+  // numbers are passed as doubles
+  values.push_back(gen_cast(v, llvm::Type::getDoubleTy(the_context)));
+  return true;
+}
+
+// gen_bounds_check - generates codes checking that the index key is in
+// [0, len), unless the same (array, key) pair is already checked on all paths
+void CodeGenerator::gen_bounds_check(const std::string &array, llvm::Value *len, llvm::Value *key) {
+  // checks in other blocks may not dominate this one, the optimizer takes
+  // care of eliminating those
+  llvm::BasicBlock *bb = ir_builder.GetInsertBlock();
+  if (bb != checked_block) {
+    checked_indices.clear();
+  }
+  if (checked_indices.count(std::make_pair(array, key))) {
+    return;
+  }
+
+  // all failed checks of a function trap in one block
+  llvm::Function *f = bb->getParent();
+  if (!bounds_fail_block) {
+    bounds_fail_block = llvm::BasicBlock::Create(the_context, "boundsfail", f);
+    llvm::IRBuilder<> fail_builder(bounds_fail_block);
+    fail_builder.CreateCall(llvm::Intrinsic::getDeclaration(the_module.get(), llvm::Intrinsic::trap));
+    fail_builder.CreateUnreachable();
+  }
+
+  // a double index is checked before it is converted, as converting a nan or
+  // one out of the range of i64 gives poison, and ordered compares fail on a
+  // nan. a negative integer index is a large unsigned one
+  llvm::Value *in_bounds = nullptr;
+  if (key->getType()->isDoubleTy()) {
+    llvm::Value *above = ir_builder.CreateFCmpOGE(key, llvm::ConstantFP::get(key->getType(), 0.0), "abovetmp");
+    llvm::Value *below = ir_builder.CreateFCmpOLT(key, ir_builder.CreateSIToFP(len, key->getType(), "lentmp"), "belowtmp");
+    in_bounds = ir_builder.CreateAnd(above, below, "inbounds");
+  } else {
+    in_bounds = ir_builder.CreateICmpULT(gen_cast(key, len->getType()), len, "inbounds");
+  }
+  llvm::BasicBlock *ok_block = llvm::BasicBlock::Create(the_context, "inbounds", f);
+  ir_builder.CreateCondBr(in_bounds, ok_block, bounds_fail_block);
+  ir_builder.SetInsertPoint(ok_block);
+
+  // ok_block is only reached from bb, so checks and values in bb still hold
+  checked_block = ok_block;
+  if (bb == shared_block) {
+    shared_block = ok_block;
+  }
+  checked_indices.insert(std::make_pair(array, key));
+}
+
+// gen_parallel_builtin - generates codes for a call to a parallel builtin,
+// whose args are of the kinds in kinds, see PARALLEL_BUILTIN_INFO
+llvm::Value *CodeGenerator::gen_parallel_builtin(const CallExprAST &ast, const std::string &runtime_function, const std::string &kinds) {
+  if (kinds.size() != ast.args.size()) {
+    throw_error_v("incorrect # arguments passed to " + ast.callee);
+    return nullptr;
+  }
+
+  // the runtime function is declared once with its C signature (runtime.h)
+  llvm::Type *double_ty = llvm::Type::getDoubleTy(the_context);
+  llvm::FunctionType *fn_type = llvm::FunctionType::get(double_ty, {double_ty}, false);
+  std::vector<llvm::Type *> arg_types;
+  for (char kind : kinds) {
+    if ('f' == kind) {
+      arg_types.push_back(fn_type->getPointerTo());
+    } else if ('a' == kind) {
+      arg_types.push_back(llvm::Type::getDoublePtrTy(the_context));
+      arg_types.push_back(llvm::Type::getInt64Ty(the_context));
+    } else {
+      arg_types.push_back(double_ty);
+    }
+  }
+  llvm::FunctionType *ft = llvm::FunctionType::get(double_ty, arg_types, false);
+  llvm::Function *rf = the_module->getFunction(runtime_function);
+  if (!rf) {
+    rf = llvm::Function::Create(ft, llvm::Function::ExternalLinkage, runtime_function, the_module.get());
+  } else if (rf->getFunctionType() != ft) {
+    throw_error_v(runtime_function + " is declared with a type other than its runtime one");
+    return nullptr;
+  }
+
+  // generates codes for each arg, checking that it is of its kind
+  std::vector<llvm::Value *> args;
+  for (unsigned i = 0, e = static_cast<unsigned>(kinds.size()); i < e; i ++) {
+    std::string position = "argument " + std::to_string(i + 1) + " of " + ast.callee;
+    auto *var = dynamic_cast<VariableExprAST *>(strip_shared(ast.args[i].get()));
+    // a variable shadows an array with the same name
+    auto a = var && !named_values.count(var->name) ? named_arrays.find(var->name) : named_arrays.end();
+
+    if ('f' == kinds[i]) {
+      llvm::Function *fn = var ? the_module->getFunction(var->name) : nullptr;
+      if (!fn || fn->isIntrinsic()) {
+        throw_error_v("expected a function as " + position);
+        return nullptr;
+      }
+      if (fn->getFunctionType() != fn_type) {
+        throw_error_v("expected a function taking one number as " + position);
+        return nullptr;
+      }
+      args.push_back(fn);
+    } else if ('a' == kinds[i]) {
+      if (named_arrays.end() == a) {
+        throw_error_v("expected an array as " + position);
+        return nullptr;
+      }
+      args.push_back(a->second.first);
+      args.push_back(a->second.second);
+    } else {
+      if (named_arrays.end() != a) {
+        throw_error_v("expected a number as " + position);
+        return nullptr;
+      }
+      ast.args[i]->accept(*this);
+      llvm::Value *v = get_ret_v();
+      if (!v) {
+        return nullptr;
+      }
+      args.push_back(gen_cast(v, double_ty));
+    }
+  }
+
+  shared_values.clear();
+  return ir_builder.CreateCall(rf, args, "calltmp");
+}
+
+// gen_profile_call - generates codes for a call to the profiler runtime
+// function, which takes the id of the function profiled
+void CodeGenerator::gen_profile_call(const std::string &runtime_function, llvm::Value *id) {
+  llvm::Function *rf = the_module->getFunction(runtime_function);
+  if (!rf) {
+    llvm::FunctionType *ft = llvm::FunctionType::get(llvm::Type::getVoidTy(the_context), {id->getType()}, false);
+    rf = llvm::Function::Create(ft, llvm::Function::ExternalLinkage, runtime_function, the_module.get());
+  }
+  ir_builder.CreateCall(rf, id);
+}
+
 // throw_error_v
 void CodeGenerator::throw_error_v(const std::string &message) {
-  std::cerr << message << std::endl;
+  error_stream << message << std::endl;
 }
@@ -1,13 +1,20 @@
 #ifndef __KLANG_CODEGEN_H__
 #define __KLANG_CODEGEN_H__
 
+#include <map>
+#include <set>
+#include <utility>
 #include "ast.h"
+#include "typer.h"
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Value.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Target/TargetMachine.h>
 
 // CodeGenerator - CodeGenerator is a visitor that can generate codes
 class CodeGenerator : public Visitor {
@@ -15,15 +22,25 @@ public:
   enum { RET_TYPE_NONE = -1, RET_TYPE_FUNCTION = 0, RET_TYPE_VALUE = 1};
 
 public:
-  CodeGenerator();
+  // a CodeGenerator reports errors to error_stream
+  CodeGenerator(std::ostream &error_stream = std::cerr);
   // visit - generates codes for NumberAST
   void visit(const NumberExprAST &ast) override;
   // visit - generates codes for VariableExprAST
   void visit(const VariableExprAST &ast) override;
+  // visit - generates codes for IndexExprAST
+  void visit(const IndexExprAST &ast) override;
   // visit - generates codes for BinaryExprAST
   void visit(const BinaryExprAST &ast) override;
   // visit - generates codes for CallExprAST
   void visit(const CallExprAST &ast) override;
+  // visit - generates codes for SharedExprAST, reusing the value generated
+  // for an earlier occurrence if it is still valid
+  void visit(const SharedExprAST &ast) override;
+  // visit - generates codes for VarExprAST
+  void visit(const VarExprAST &ast) override;
+  // visit - generates codes for ForExprAST
+  void visit(const ForExprAST &ast) override;
   // visit - generates codes for PrototypeAST
   void visit(const PrototypeAST &ast) override;
   // visit - generates codes for FunctionAST
@@ -34,22 +51,128 @@ public:
   llvm::Value *get_ret_v();
   // get_ret_f - gets the RET_TYPE_FUNCTIONed value ret_f
   llvm::Function *get_ret_f();
+  // get_context - gets the context that codes are generated in
+  llvm::LLVMContext &get_context();
+  // get_module - gets the module that codes are generated into
+  const llvm::Module &get_module() const;
+  // set_target_machine - generates codes for tm, which also enables the
+  // target's cost model in optimizations, e.g. vectorization
+  void set_target_machine(llvm::TargetMachine *tm);
+  // take_specializations - takes the specializations created since the last
+  // call, which must be compiled before the functions calling them
+  std::vector<llvm::Function *> take_specializations();
+  // set_redefinable - allows defining a function again, the old definition is
+  // replaced in the module once the new one is generated
+  void set_redefinable(bool redefinable);
+  // set_profiling - instruments the entry and exit of each named function
+  // defined later for the profiler
+  void set_profiling(bool profiling);
+  // set_specializing - enables or disables calling specializations of callees
+  // on literal args, which depend on the bodies of the callees, not only on
+  // their types. enabled by default
+  void set_specializing(bool specializing);
 
 private:
+  // SpecializationKey - a callee, and the llvm argument positions bound to constants
+  typedef std::pair<std::string, std::vector<std::pair<unsigned, double>>> SpecializationKey;
+
+private:
+  // create_fpm - creates the function pass manager, which uses the cost model
+  // of tm if not nullptr
+  void create_fpm(llvm::TargetMachine *tm);
   // set_ret_none - set RET_TYPE_NONE when failed
   void set_ret_none();
   // set_ret_value - set RET_TYPE_FUNCTION
   void set_ret_value(llvm::Function *f);
   // set_ret_value - set RET_TYPE_VALUE
   void set_ret_value(llvm::Value *v);
+  // get_builtin - gets the intrinsic that builtin name is lowered to, or nullptr
+  llvm::Function *get_builtin(const std::string &name);
+  // create_entry_alloca - creates a stack slot of type ty of a mutable variable
+  // in the entry block of f, which mem2reg promotes to registers
+  llvm::AllocaInst *create_entry_alloca(llvm::Function *f, const std::string &name, llvm::Type *ty);
+  // get_llvm_type - gets the llvm type of a TypeInferer type
+  llvm::Type *get_llvm_type(int type);
+  // gen_cast - generates codes converting v to ty, only ever widening it, i.e.
+  // i1 to i64 and i1 or i64 to double, returns nullptr if ty is narrower
+  llvm::Value *gen_cast(llvm::Value *v, llvm::Type *ty);
+  // gen_cond - generates codes for checking that the condition v is non-zero
+  llvm::Value *gen_cond(llvm::Value *v);
+  // gen_binop - generates codes for an arithmetic or comparison binop whose
+  // result is inferred of type, on integers if both l and r are integers or
+  // booleans and the result is not a double, otherwise on doubles
+  llvm::Value *gen_binop(char op, llvm::Value *l, llvm::Value *r, int type, const std::string &name = "");
+  // gen_assign - generates codes for an assignment "lhs = rhs"
+  llvm::Value *gen_assign(const BinaryExprAST &ast);
+  // gen_elem_ptr - generates codes for the address of an array element
+  llvm::Value *gen_elem_ptr(const IndexExprAST &ast);
+  // get_specialization - gets the clone of callee with the args in key bound
+  // to their constants, or nullptr if the generic callee should be called
+  llvm::Function *get_specialization(llvm::Function *callee, const SpecializationKey &key);
+  // create_specialization - creates the clone of callee with the args in key
+  // bound to their constants, or nullptr if it does not pay off
+  llvm::Function *create_specialization(llvm::Function *callee, const SpecializationKey &key);
+  // create_forwarder - creates a function of the type of the specialization of
+  // callee for key, which calls callee with the args in key bound
+  llvm::Function *create_forwarder(llvm::Function *callee, const SpecializationKey &key);
+  // retire - retires old, which f redefines, old and its specializations are
+  // erased once nothing calls them any more
+  void retire(llvm::Function *old, llvm::Function *f);
+  // discard_specializations - erases the specializations created since there
+  // were n of them, which nothing calls
+  void discard_specializations(size_t n);
+  // calls_retired - checks whether f calls a retired function, or passes one
+  // to a parallel builtin
+  bool calls_retired(const llvm::Function &f);
+  // gen_arg - generates codes for an arg of a call, an array is passed as
+  // its (data, length) pair, returns false if failed
+  bool gen_arg(ExprAST &ast, std::vector<llvm::Value *> &values);
+  // gen_bounds_check - generates codes checking that the index key is in
+  // [0, len), unless the same (array, key) pair is already checked on all paths
+  void gen_bounds_check(const std::string &array, llvm::Value *len, llvm::Value *key);
+  // gen_parallel_builtin - generates codes for a call to a parallel builtin,
+  // whose args are of the kinds in kinds, see PARALLEL_BUILTIN_INFO
+  llvm::Value *gen_parallel_builtin(const CallExprAST &ast, const std::string &runtime_function, const std::string &kinds);
+  // gen_profile_call - generates codes for a call to the profiler runtime
+  // function, which takes the id of the function profiled
+  void gen_profile_call(const std::string &runtime_function, llvm::Value *id);
   // throw_error_v
   void throw_error_v(const std::string &message);
 
+private:
+  // builtins maps each builtin to its (intrinsic, arity)
+  static const std::map<std::string, std::pair<llvm::Intrinsic::ID, unsigned>> builtins;
+  // parallel_builtins maps each parallel builtin to its (runtime function, args)
+  static const std::map<std::string, std::pair<std::string, std::string>> parallel_builtins;
+
 private:
   llvm::LLVMContext                     the_context;
   std::unique_ptr<llvm::Module>         the_module;
   llvm::IRBuilder<>                     ir_builder;
-  std::map<std::string, llvm::Value *>  named_values;
+  // type_inferer infers the types of the variables of the function generated
+  TypeInferer                           type_inferer;
+  // named_values maps each variable (and argument) to its stack slot
+  std::map<std::string, llvm::AllocaInst *> named_values;
+  // named_arrays maps each array argument to its (data, length) pair
+  std::map<std::string, std::pair<llvm::Value *, llvm::Value *>> named_arrays;
+  // checked_indices are (array, index) pairs checked on all paths to checked_block
+  std::set<std::pair<std::string, llvm::Value *>> checked_indices;
+  llvm::BasicBlock                     *checked_block     = nullptr;
+  // shared_values are values of shared expressions generated on all paths to
+  // shared_block, they are forgotten whenever a variable or an array changes
+  std::map<const ExprAST *, llvm::Value *> shared_values;
+  llvm::BasicBlock                     *shared_block      = nullptr;
+  llvm::BasicBlock                     *bounds_fail_block = nullptr;
+  // specializations caches the clone for each key, nullptr if it did not pay off
+  std::map<SpecializationKey, llvm::Function *> specializations;
+  std::vector<llvm::Function *>         new_specializations;
+  // retired are functions redefined, or specializations of them, still called
+  std::vector<llvm::Function *>         retired;
+  bool                                  redefinable       = false;
+  bool                                  profiling         = false;
+  bool                                  specializing      = true;
+  std::unique_ptr<llvm::legacy::FunctionPassManager> the_fpm;
+  std::ostream                         &error_stream;
 
   int ret_type;
   union {
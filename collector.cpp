@@ -0,0 +1,76 @@
+#include "collector.h"
+#include "def.h"
+
+// visit - collects nothing from NumberExprAST
+void CallCollector::visit(const NumberExprAST &) {}
+
+// visit - collects nothing from VariableExprAST
+void CallCollector::visit(const VariableExprAST &) {}
+
+// visit - collects calls in IndexExprAST
+void CallCollector::visit(const IndexExprAST &ast) {
+  ast.index->accept(*this);
+}
+
+// visit - collects calls in BinaryExprAST
+void CallCollector::visit(const BinaryExprAST &ast) {
+  ast.lhs->accept(*this);
+  ast.rhs->accept(*this);
+}
+
+// visit - collects CallExprAST, and calls in its args, a function passed to
+// a parallel builtin is called too
+void CallCollector::visit(const CallExprAST &ast) {
+  callees.insert(ast.callee);
+  static const std::set<std::string> parallel_builtins = {
+    #define X(a, b, c) #a,
+    PARALLEL_BUILTIN_INFO
+    #undef X
+  };
+  auto *fn = ast.args.empty() ? nullptr : dynamic_cast<VariableExprAST *>(strip_shared(ast.args[0].get()));
+  if (fn && parallel_builtins.count(ast.callee)) {
+    callees.insert(fn->name);
+  }
+
+  for (auto &arg : ast.args) {
+    arg->accept(*this);
+  }
+}
+
+// visit - collects calls in SharedExprAST
+void CallCollector::visit(const SharedExprAST &ast) {
+  ast.expr->accept(*this);
+}
+
+// visit - collects calls in VarExprAST
+void CallCollector::visit(const VarExprAST &ast) {
+  for (auto &var : ast.vars) {
+    if (var.second) {
+      var.second->accept(*this);
+    }
+  }
+  ast.body->accept(*this);
+}
+
+// visit - collects calls in ForExprAST
+void CallCollector::visit(const ForExprAST &ast) {
+  ast.start->accept(*this);
+  ast.end->accept(*this);
+  if (ast.step) {
+    ast.step->accept(*this);
+  }
+  ast.body->accept(*this);
+}
+
+// visit - collects nothing from PrototypeAST
+void CallCollector::visit(const PrototypeAST &) {}
+
+// visit - collects calls in FunctionAST
+void CallCollector::visit(const FunctionAST &ast) {
+  ast.body->accept(*this);
+}
+
+// get_callees - gets the names of the functions called
+const std::set<std::string> &CallCollector::get_callees() const {
+  return callees;
+}
@@ -0,0 +1,40 @@
+#ifndef __KLANG_COLLECTOR_H__
+#define __KLANG_COLLECTOR_H__
+
+#include <set>
+#include <string>
+#include "ast.h"
+
+// CallCollector - CallCollector is a visitor that collects the names of all
+// functions an AST calls
+class CallCollector : public Visitor {
+public:
+  // visit - collects nothing from NumberExprAST
+  void visit(const NumberExprAST &ast) override;
+  // visit - collects nothing from VariableExprAST
+  void visit(const VariableExprAST &ast) override;
+  // visit - collects calls in IndexExprAST
+  void visit(const IndexExprAST &ast) override;
+  // visit - collects calls in BinaryExprAST
+  void visit(const BinaryExprAST &ast) override;
+  // visit - collects CallExprAST, and calls in its args, a function passed to
+  // a parallel builtin is called too
+  void visit(const CallExprAST &ast) override;
+  // visit - collects calls in SharedExprAST
+  void visit(const SharedExprAST &ast) override;
+  // visit - collects calls in VarExprAST
+  void visit(const VarExprAST &ast) override;
+  // visit - collects calls in ForExprAST
+  void visit(const ForExprAST &ast) override;
+  // visit - collects nothing from PrototypeAST
+  void visit(const PrototypeAST &ast) override;
+  // visit - collects calls in FunctionAST
+  void visit(const FunctionAST &ast) override;
+  // get_callees - gets the names of the functions called
+  const std::set<std::string> &get_callees() const;
+
+private:
+  std::set<std::string> callees;
+};
+
+#endif
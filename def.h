@@ -7,14 +7,61 @@
   X(def,        2) \
   X(extern,     3) \
   X(identifier, 4) \
-  X(numval,     5)
+  X(numval,     5) \
+  X(var,        6) \
+  X(in,         7) \
+  X(for,        8) \
+  X(command,    9)
 
 // X(operator, name, operator_priority)
 // all priority must be great than or equal to 1
 #define OPERATOR_INFO \
-  X('<', lt,  10) \
-  X('+', add, 20) \
-  X('-', sub, 20) \
-  X('*', mul, 40)
+  X(':', seq,     1) \
+  X('=', assign,  2) \
+  X('<', lt,     10) \
+  X('+', add,    20) \
+  X('-', sub,    20) \
+  X('*', mul,    40)
+
+// X(builtin, llvm_intrinsic, arity)
+// builtins are lowered to llvm intrinsics instead of opaque libm calls,
+// so that the optimizer can fold, hoist and vectorize them
+#define BUILTIN_INFO \
+  X(sqrt,  sqrt,   1) \
+  X(sin,   sin,    1) \
+  X(cos,   cos,    1) \
+  X(exp,   exp,    1) \
+  X(log,   log,    1) \
+  X(fabs,  fabs,   1) \
+  X(floor, floor,  1) \
+  X(ceil,  ceil,   1) \
+  X(pow,   pow,    2) \
+  X(min,   minnum, 2) \
+  X(max,   maxnum, 2)
+
+// X(builtin, runtime_function, args)
+// parallel builtins take a function as their first argument, and are
+// lowered to calls into the runtime work-stealing scheduler (runtime.h).
+// each character of args is the kind of an argument: 'f' a function taking
+// one number, 'n' a number, or 'a' an array passed as its (data, length)
+#define PARALLEL_BUILTIN_INFO \
+  X(parallel_sum, klang_parallel_sum, "fnn") \
+  X(parallel_map, klang_parallel_map, "fnna")
+
+// X(llvm_intrinsic, vector_function, vectorization_factor, target_feature)
+// vector variants (glibc libmvec, x86-64 only) of builtins that have no
+// native vector instruction, used when the vectorizer widens a call to a
+// builtin, if the target has target_feature (none if "")
+#define VECLIB_INFO \
+  X("llvm.sin.f64", "_ZGVbN2v_sin",  2, "") \
+  X("llvm.sin.f64", "_ZGVdN4v_sin",  4, "+avx2") \
+  X("llvm.cos.f64", "_ZGVbN2v_cos",  2, "") \
+  X("llvm.cos.f64", "_ZGVdN4v_cos",  4, "+avx2") \
+  X("llvm.exp.f64", "_ZGVbN2v_exp",  2, "") \
+  X("llvm.exp.f64", "_ZGVdN4v_exp",  4, "+avx2") \
+  X("llvm.log.f64", "_ZGVbN2v_log",  2, "") \
+  X("llvm.log.f64", "_ZGVdN4v_log",  4, "+avx2") \
+  X("llvm.pow.f64", "_ZGVbN2vv_pow", 2, "") \
+  X("llvm.pow.f64", "_ZGVdN4vv_pow", 4, "+avx2")
 
 #endif
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include <iostream>
+#include <limits>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include "def.h"
+#include "jit.h"
+#include "profiler.h"
+#include "runtime.h"
+
+JIT::JIT(llvm::LLVMContext &context)
+  : context(context) {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+  llvm::InitializeNativeTargetAsmParser();
+
+  // externs are resolved in the process, the runtime is linked in klang
+  llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+  #define X(a, b, c) add_runtime_function(#b, reinterpret_cast<void *>(&b));
+  PARALLEL_BUILTIN_INFO
+  #undef X
+  add_runtime_function("klang_prof_enter", reinterpret_cast<void *>(&klang_prof_enter));
+  add_runtime_function("klang_prof_exit", reinterpret_cast<void *>(&klang_prof_exit));
+
+  std::string error;
+  engine.reset(llvm::EngineBuilder(llvm::make_unique<llvm::Module>("jit", context))
+                 .setErrorStr(&error)
+                 .setEngineKind(llvm::EngineKind::JIT)
+                 .setMCJITMemoryManager(llvm::make_unique<llvm::SectionMemoryManager>())
+                 .create());
+  if (!engine) {
+    std::cerr << "cannot create jit: " << error << std::endl;
+  }
+}
+
+JIT::~JIT() {}
+
+// undefined - the function a slot holds until the function is defined, if
+// it is not found in the process either. it is called as a function of any
+// type, which is harmless as the caller passes and cleans up the arguments
+static double undefined() {
+  std::cerr << "called a function which is declared, but not defined" << std::endl;
+  return std::numeric_limits<double>::quiet_NaN();
+}
+
+// make_symbol - makes the symbol to compile f as, which is its name, or
+// "name.vN" for the N-th redefinition of it, or a fresh one for an anonymous
+// function (top level expression)
+std::string JIT::make_symbol(const llvm::Function &f) {
+  std::string symbol = f.getName().str();
+  if (symbol.empty()) {
+    symbol = "__anon_expr" + std::to_string(n_anonymous ++);
+  } else if (unsigned n = n_versions[symbol] ++) {
+    symbol += ".v" + std::to_string(n);
+  }
+  return symbol;
+}
+
+// add - compiles f as symbol, returns false if failed
+bool JIT::add(const llvm::Function &f, const std::string &symbol) {
+  if (!engine || f.empty()) {
+    return false;
+  }
+
+  auto m = llvm::make_unique<llvm::Module>(symbol, context);
+  llvm::Function *nf = llvm::Function::Create(f.getFunctionType(), llvm::Function::ExternalLinkage, symbol, m.get());
+
+  llvm::ValueToValueMapTy vmap;
+  auto nf_arg = nf->arg_begin();
+  for (auto &arg : f.args()) {
+    nf_arg->setName(arg.getName());
+    vmap[&arg] = &*nf_arg ++;
+  }
+
+  // declares all functions f refers to, intrinsics and runtime functions are
+  // resolved at link time, other functions are called via their slots
+  vmap[&f] = nf;
+  std::vector<std::pair<llvm::Function *, Slot *>> slotted;
+  for (auto &bb : f) {
+    for (auto &inst : bb) {
+      for (auto &op : inst.operands()) {
+        auto *callee = llvm::dyn_cast<llvm::Function>(op);
+        if (callee && !vmap.count(callee)) {
+          auto *decl = llvm::cast<llvm::Function>(m->getOrInsertFunction(callee->getName(), callee->getFunctionType()));
+          if (!callee->isIntrinsic() && !runtime_functions.count(callee->getName().str())) {
+            slotted.push_back(std::make_pair(decl, get_slot(*callee)));
+          }
+          vmap[callee] = decl;
+        }
+      }
+    }
+  }
+
+  llvm::SmallVector<llvm::ReturnInst *, 8> returns;
+  llvm::CloneFunctionInto(nf, &f, vmap, true, returns);
+
+  // each use of a compiled function loads its current address from its slot
+  for (auto &s : slotted) {
+    std::vector<llvm::Use *> uses;
+    for (auto &use : s.first->uses()) {
+      uses.push_back(&use);
+    }
+    for (auto *use : uses) {
+      llvm::IRBuilder<> builder(llvm::cast<llvm::Instruction>(use->getUser()));
+      llvm::Value *addr = builder.CreateIntToPtr(builder.getInt64(reinterpret_cast<uint64_t>(s.second)),
+                                                 s.first->getType()->getPointerTo(), "slotaddr");
+      llvm::LoadInst *target = builder.CreateLoad(addr, s.first->getName() + ".slot");
+      target->setAlignment(sizeof(void *));
+      target->setAtomic(llvm::Acquire);
+      use->set(target);
+    }
+    s.first->eraseFromParent();
+  }
+
+  engine->addModule(std::move(m));
+  engine->finalizeObject();
+  for (auto *listener : listeners) {
+    listener->flush_jitdump();
+  }
+
+  // callers, including those compiled earlier, call this version from now
+  // on, calls in flight finish in the old one, whose codes are kept
+  if (!f.getName().empty()) {
+    get_slot(f)->store(reinterpret_cast<void *>(engine->getFunctionAddress(symbol)), std::memory_order_release);
+  }
+  return true;
+}
+
+// get_slot - gets the slot of f, a new slot holds the function of the name
+// of f in the process (e.g. an extern of libm), or undefined
+JIT::Slot *JIT::get_slot(const llvm::Function &f) {
+  auto &slot = slots[std::make_pair(f.getName().str(), f.getFunctionType())];
+  if (!slot) {
+    void *addr = llvm::sys::DynamicLibrary::SearchForAddressOfSymbol(f.getName().str());
+    slot = llvm::make_unique<Slot>(addr ? addr : reinterpret_cast<void *>(&undefined));
+  }
+  return slot.get();
+}
+
+// add_runtime_function - makes the runtime function name at addr callable
+// from compiled codes, which call it directly
+void JIT::add_runtime_function(const std::string &name, void *addr) {
+  llvm::sys::DynamicLibrary::AddSymbol(name, addr);
+  runtime_functions.insert(name);
+}
+
+// get_address - gets the address of a compiled symbol, or 0
+uint64_t JIT::get_address(const std::string &symbol) {
+  return engine ? engine->getFunctionAddress(symbol) : 0;
+}
+
+// register_listener - registers a listener notified of all emitted objects,
+// which writes their jitdump records once they are finalized
+void JIT::register_listener(PerfMapListener *listener) {
+  if (engine) {
+    engine->RegisterJITEventListener(listener);
+    listeners.push_back(listener);
+  }
+}
+
+// get_target_machine - gets the target machine codes are compiled for
+llvm::TargetMachine *JIT::get_target_machine() {
+  return engine ? engine->getTargetMachine() : nullptr;
+}
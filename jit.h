@@ -0,0 +1,76 @@
+#ifndef __KLANG_JIT_H__
+#define __KLANG_JIT_H__
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/Target/TargetMachine.h>
+#include "perf_map.h"
+
+// JIT - compiles functions generated by a CodeGenerator to native codes with
+// MCJIT, each function is cloned into a module of its own.
+//
+// each named function called or compiled gets a slot, like an entry of a
+// GOT, holding the address of its latest version. compiled codes call all
+// functions but intrinsics and runtime functions indirectly via their slots,
+// so redefining a function (of the same type) only compiles the new body, and
+// swaps the address in its slot, and a function declared by extern may be
+// called before it is defined. codes are never freed, so calls in flight
+// finish in the old version.
+class JIT {
+public:
+  // a JIT compiles functions living in context
+  JIT(llvm::LLVMContext &context);
+  ~JIT();
+  // make_symbol - makes the symbol to compile f as, which is its name, or
+  // "name.vN" for the N-th redefinition of it, or a fresh one for an anonymous
+  // function (top level expression)
+  std::string make_symbol(const llvm::Function &f);
+  // add - compiles f as symbol, returns false if failed
+  bool add(const llvm::Function &f, const std::string &symbol);
+  // get_address - gets the address of a compiled symbol, or 0
+  uint64_t get_address(const std::string &symbol);
+  // register_listener - registers a listener notified of all emitted objects,
+  // which writes their jitdump records once they are finalized
+  void register_listener(PerfMapListener *listener);
+  // get_target_machine - gets the target machine codes are compiled for
+  llvm::TargetMachine *get_target_machine();
+
+private:
+  // Slot - the address of the latest version of a function
+  typedef std::atomic<void *> Slot;
+
+private:
+  // get_slot - gets the slot of f, creating it if f has none yet
+  Slot *get_slot(const llvm::Function &f);
+  // add_runtime_function - makes the runtime function name at addr callable
+  // from compiled codes, which call it directly
+  void add_runtime_function(const std::string &name, void *addr);
+
+private:
+  llvm::LLVMContext                      &context;
+  std::unique_ptr<llvm::ExecutionEngine>  engine;
+  unsigned                                n_anonymous = 0;
+  // listeners are notified of all emitted objects
+  std::vector<PerfMapListener *>          listeners;
+  // runtime_functions are the functions of klang called directly
+  std::set<std::string>                   runtime_functions;
+
+  // n_versions counts the symbols made for each function name
+  std::map<std::string, unsigned>         n_versions;
+  // slots maps each function (name, type) called or compiled to its slot,
+  // a function redefined with another type gets another slot, its callers
+  // compiled earlier keep calling the old version
+  std::map<std::pair<std::string, llvm::FunctionType *>, std::unique_ptr<Slot>> slots;
+};
+
+#endif
@@ -22,6 +22,17 @@ int Lexer::get_curr_token() {
   return curr_token;
 }
 
+unsigned Lexer::get_curr_line() const {
+  return curr_line;
+}
+
+// set_commands - enables or disables commands, a command is a line that
+// starts with ':', recognized as token_command whose identifier is the rest
+// of the line
+void Lexer::set_commands(bool enabled) {
+  commands = enabled;
+}
+
 int Lexer::advance() {
   return curr_token = get_token();
 }
@@ -29,13 +40,27 @@ int Lexer::advance() {
 int Lexer::get_token() {
   // skip any whitespace.
   while (isspace(last_char)) {
-    last_char = input_stream.get();
+    last_char = read_char();
+  }
+  bool line_start = line != curr_line;
+  curr_line = line;
+
+  // command: ':' first on a line, then the rest of the line, otherwise ':'
+  // would continue the expression on the line before as a sequence
+  if (commands && line_start && ':' == last_char) {
+    curr_identifier.clear();
+    while (EOF != (last_char = read_char()) && '\n' != last_char) {
+      curr_identifier += last_char;
+    }
+    curr_identifier.erase(0, curr_identifier.find_first_not_of(" \t\r"));
+    curr_identifier.erase(curr_identifier.find_last_not_of(" \t\r") + 1);
+    return token_command;
   }
 
-  // identifier: [a-zA-Z][a-zA-Z0-9]*
-  if (isalpha(last_char)) {
+  // identifier: [a-zA-Z_][a-zA-Z0-9_]*
+  if (isalpha(last_char) || '_' == last_char) {
     curr_identifier = last_char;
-    while(isalnum((last_char = input_stream.get()))) {
+    while(isalnum((last_char = read_char())) || '_' == last_char) {
       curr_identifier += last_char;
     }
 
@@ -43,6 +68,12 @@ int Lexer::get_token() {
       return token_extern;
     } else if (curr_identifier == TOKENS_STR[-token_def]) {
       return token_def;
+    } else if (curr_identifier == TOKENS_STR[-token_var]) {
+      return token_var;
+    } else if (curr_identifier == TOKENS_STR[-token_in]) {
+      return token_in;
+    } else if (curr_identifier == TOKENS_STR[-token_for]) {
+      return token_for;
     }
 
     return token_identifier;
@@ -53,7 +84,7 @@ int Lexer::get_token() {
     std::string number_str;
     do {
       number_str += last_char;
-      last_char = input_stream.get();
+      last_char = read_char();
     } while (isdigit(last_char) || '.' == last_char);
 
     curr_numval = strtod(number_str.c_str(), NULL);
@@ -63,7 +94,7 @@ int Lexer::get_token() {
   // comments
   if ('#' == last_char) {
     do {
-      last_char = input_stream.get();
+      last_char = read_char();
     } while (!input_stream.eof() && '\r' != last_char && '\n' != last_char);
 
     if (!input_stream.eof()) {
@@ -78,7 +109,14 @@ int Lexer::get_token() {
 
   // for others, we just return themselves, e.g. '+'.
   int this_char = last_char;
-  last_char = input_stream.get();
+  last_char = read_char();
 
   return this_char;
+}
+
+int Lexer::read_char() {
+  if ('\n' == last_char) {
+    line ++;
+  }
+  return input_stream.get();
 }
\ No newline at end of file
@@ -37,14 +37,22 @@ public:
   double get_curr_numval() const;
   // get_curr_identifier - returns curr_identifier
   std::string get_curr_identifier() const;
+  // set_commands - enables or disables commands, a command is a line that
+  // starts with ':', recognized as token_command whose identifier is the
+  // rest of the line
+  void set_commands(bool enabled);
   // advance - make the lexer advance one step: recognize next token
   int advance();
   // get_curr_token - gets the current token that the lexer recognized just now
   int get_curr_token();
+  // get_curr_line - gets the line (from 1) of the current token
+  unsigned get_curr_line() const;
 
 private:
   // get_token - Return the next token from standard input
   int get_token();
+  // read_char - reads a char from input_stream, counting lines
+  int read_char();
 
 private:
   std::istream &input_stream;
@@ -52,6 +60,9 @@ private:
   std::string   curr_identifier = "";  // filled in if tok_identifier
   double        curr_numval     = 0;   // filled in if tok_number
   int           curr_token      = ';'; // curr_token stores the token recognized just now
+  unsigned      line            = 1;   // line of last_char
+  unsigned      curr_line       = 0;   // line of curr_token, 0 before the first token
+  bool          commands        = false;
 
 };
 
@@ -1,9 +1,19 @@
+#include <csignal>
+#include <cstdlib>
 #include <iostream>
+#include <mutex>
+#include <sstream>
 #include <llvm/ADT/STLExtras.h>
-#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/raw_os_ostream.h>
 #include "lexer.h"
 #include "parser.h"
 #include "codegen.h"
+#include "jit.h"
+#include "perf_map.h"
+#include "profiler.h"
+#include "server.h"
+#include "thread_pool.h"
+#include "watch.h"
 
 class REPL {
 public:
@@ -21,57 +31,333 @@ public:
   }
 
 public:
+  // run - reads and handles top levels until eof. parsing a top level reads
+  // the token after it, which the next one starts with
   void run() {
+    print("> ", "");
+    lexer->advance();
     while (1) {
-      std::cout << "> " << std::flush;
-      lexer->advance();
       if (lexer->get_curr_token() == Lexer::token_eof) {
         return;
+      } else if (Lexer::token_command == lexer->get_curr_token()) {
+        handle_command();
       } else {
+        // a top level that fails to parse, or ';', is skipped a token at a
+        // time, up to a command
         std::unique_ptr<AST> ast;
         do {
           ast = parser->parse_top();
-        } while(!ast && lexer->advance());
-        ast->accept(*code_gen);
-        switch (code_gen->get_ret_type()) {
-        default:
-          std::cerr << "unknown ret type" << std::endl; break;
-        case CodeGenerator::RET_TYPE_NONE: case CodeGenerator::RET_TYPE_VALUE:
-          std::cerr << "this will not ever happen!" << std::endl; break;
-        case CodeGenerator::RET_TYPE_FUNCTION:
-          handle_ret_v(code_gen->get_ret_f()); break;
+        } while (!ast && Lexer::token_eof != lexer->advance() && Lexer::token_command != lexer->get_curr_token());
+        print("", take(parse_errors));
+
+        if (!ast) {
+          continue;
+        } else if (!compile_pool) {
+          compile(*ast, std::cout, std::cerr);
+        } else {
+          // the pool needs a copyable task, whose output is printed at once
+          std::shared_ptr<AST> shared_ast(std::move(ast));
+          compile_pool->submit([this, shared_ast]() {
+            std::ostringstream out, err;
+            compile(*shared_ast, out, err);
+            print(out.str(), err.str());
+          });
         }
       }
+      print("> ", "");
+    }
+  }
+
+  // enable_profiling - profiles functions defined later, see ":profile"
+  void enable_profiling() {
+    code_gen->set_profiling(true);
+  }
+
+  // enable_async - compiles (and evaluates) in the background, so the next
+  // prompt only waits for parsing. codes are generated into a single module
+  // of a single context, neither of which is thread-safe, so the one compile
+  // thread handles top level ASTs in order, and an expression is evaluated
+  // only after every function it may call is compiled
+  void enable_async() {
+    compile_pool = llvm::make_unique<ThreadPool>(1);
+  }
+
+  void set_hash_consing(bool enabled) {
+    parser->set_hash_consing(enabled);
+  }
+
+  // enable_jit - compiles definitions to native codes and evaluates top
+  // level expressions, optionally reporting jitted functions to perf
+  void enable_jit(bool perf_map, bool jitdump) {
+    jit = llvm::make_unique<JIT>(code_gen->get_context());
+    if (llvm::TargetMachine *tm = jit->get_target_machine()) {
+      code_gen->set_target_machine(tm);
     }
+    if (perf_map || jitdump) {
+      perf_listener = llvm::make_unique<PerfMapListener>(jitdump);
+      jit->register_listener(perf_listener.get());
+    }
+    // a definition replaces an earlier one of the same name, which the jit
+    // swaps in for its callers via their slots
+    code_gen->set_redefinable(true);
   }
 
 private:
-  void handle_ret_v(llvm::Function *f) {
-    std::cout << "read function" << std::endl;
-    f->print(llvm::errs());
-    std::cerr << std::endl;
+  // handle_command - handles a command, which is a line of ':' followed by
+  // a name
+  void handle_command() {
+    if ("profile" == lexer->get_curr_identifier()) {
+      print(Profiler::get_instance().report(), "");
+    } else {
+      print("", "unknown command\n");
+    }
+    lexer->advance(); // eat the command
+  }
+
+  // compile - generates codes for ast, and compiles and evaluates them with
+  // the jit if enabled
+  void compile(AST &ast, std::ostream &out, std::ostream &err) {
+    ast.accept(*code_gen);
+    err << take(code_gen_errors);
+    switch (code_gen->get_ret_type()) {
+    default:
+      err << "unknown ret type" << std::endl; break;
+    case CodeGenerator::RET_TYPE_NONE: case CodeGenerator::RET_TYPE_VALUE:
+      err << "this will not ever happen!" << std::endl; break;
+    case CodeGenerator::RET_TYPE_FUNCTION:
+      handle_ret_v(code_gen->get_ret_f(), get_line(ast), out, err); break;
+    }
+  }
+
+  void handle_ret_v(llvm::Function *f, unsigned line, std::ostream &out, std::ostream &err) {
+    llvm::raw_os_ostream ir_stream(err);
+    out << "read function" << std::endl;
+    f->print(ir_stream);
+    ir_stream.flush();
+    err << std::endl;
+
+    // specializations called by f are compiled before f
+    for (llvm::Function *spec : code_gen->take_specializations()) {
+      out << "read specialization" << std::endl;
+      spec->print(ir_stream);
+      ir_stream.flush();
+      err << std::endl;
+      if (jit) {
+        handle_jit(spec, 0, out, err);
+      }
+    }
+
+    if (jit && !f->empty()) {
+      handle_jit(f, line, out, err);
+    }
+  }
+
+  void handle_jit(llvm::Function *f, unsigned line, std::ostream &out, std::ostream &err) {
+    std::string symbol = jit->make_symbol(*f);
+    if (perf_listener) {
+      std::string name = f->getName().empty() ? "<toplevel>" : f->getName().str();
+      perf_listener->set_location(symbol, name, "<stdin>", line);
+    }
+
+    if (!jit->add(*f, symbol)) {
+      err << "cannot compile function" << std::endl;
+      return;
+    }
+
+    // evaluates a top level expression
+    if (f->getName().empty()) {
+      auto fp = reinterpret_cast<double (*)()>(jit->get_address(symbol));
+      if (fp) {
+        out << "evaluated to " << fp() << std::endl;
+      }
+    }
+  }
+
+  // print - prints out and err, which the compile thread may print at the
+  // same time as the prompt
+  void print(const std::string &out, const std::string &err) {
+    std::lock_guard<std::mutex> lock(output_mutex);
+    std::cout << out << std::flush;
+    std::cerr << err << std::flush;
+  }
+
+  // take - takes the contents of stream
+  static std::string take(std::ostringstream &stream) {
+    std::string contents = stream.str();
+    stream.str("");
+    return contents;
+  }
+
+  static unsigned get_line(AST &ast) {
+    if (auto *def = dynamic_cast<FunctionAST *>(&ast)) {
+      return def->proto->line;
+    } else if (auto *proto = dynamic_cast<PrototypeAST *>(&ast)) {
+      return proto->line;
+    }
+    return 0;
   }
 
 private:
   REPL() {
     lexer    = llvm::make_unique<Lexer>(std::cin);
-    parser   = llvm::make_unique<Parser>(*lexer);
-    code_gen = llvm::make_unique<CodeGenerator>();
+    lexer->set_commands(true);
+    parser   = llvm::make_unique<Parser>(*lexer, parse_errors);
+    code_gen = llvm::make_unique<CodeGenerator>(code_gen_errors);
   }
 
 private:
   static REPL *instance;
 
 private:
+  // errors are collected, and printed along with the other output
+  std::ostringstream             parse_errors;
+  std::ostringstream             code_gen_errors;
+  std::mutex                     output_mutex;
   std::unique_ptr<Lexer>         lexer;
   std::unique_ptr<Parser>        parser;
   std::unique_ptr<CodeGenerator> code_gen;
+  // jit is destroyed before code_gen, which owns the context, and before
+  // perf_listener, which it notifies until destroyed
+  std::unique_ptr<PerfMapListener> perf_listener;
+  std::unique_ptr<JIT>             jit;
+  // compile_pool is destroyed first, after finishing all pending compiles
+  std::unique_ptr<ThreadPool>      compile_pool;
 };
 
 REPL *REPL::instance = nullptr;
 
+static Server  *server  = nullptr;
+static Watcher *watcher = nullptr;
+
+// stop_server - stops the server on SIGINT/SIGTERM
+static void stop_server(int) {
+  server->stop();
+}
+
+// stop_watcher - stops the watcher on SIGINT/SIGTERM
+static void stop_watcher(int) {
+  watcher->stop();
+}
+
+// watch - compiles (and with jit, runs) path whenever it changes, optionally
+// reporting jitted functions to perf
+static int watch(const std::string &path, bool hash_consing, bool jit, bool perf_map, bool jitdump, bool profile) {
+  CodeGenerator                    code_gen;
+  code_gen.set_profiling(profile);
+  // j is destroyed before perf_listener, which it notifies until destroyed
+  std::unique_ptr<PerfMapListener> perf_listener;
+  std::unique_ptr<JIT>             j;
+  if (jit) {
+    j = llvm::make_unique<JIT>(code_gen.get_context());
+    if (llvm::TargetMachine *tm = j->get_target_machine()) {
+      code_gen.set_target_machine(tm);
+    }
+    if (perf_map || jitdump) {
+      perf_listener = llvm::make_unique<PerfMapListener>(jitdump);
+      j->register_listener(perf_listener.get());
+    }
+  }
+
+  Watcher w(path, code_gen, j.get());
+  w.set_hash_consing(hash_consing);
+  w.set_perf_listener(perf_listener.get());
+  watcher = &w;
+  signal(SIGINT, stop_watcher);
+  signal(SIGTERM, stop_watcher);
+  return w.run();
+}
+
+// usage - prints usage
+static int usage(const char *name) {
+  std::cerr << "usage: " << name << " [--hash-consing] [--jit] [--perf-map] [--jitdump] [--async] [--profile]"
+            << " [--server <socket-path> [--threads <n>]"
+            << " [--max-request-bytes <n>] [--max-instructions <n>] [--max-request-ms <n>]]"
+            << " [--watch <file>]"
+            << std::endl;
+  return 1;
+}
+
 int main(int argc, char* argv[]) {
+  std::string   socket_path;
+  std::string   watch_path;
+  unsigned      n_threads = 0;
+  SessionLimits limits;
+  bool          hash_consing = false;
+  bool          jit          = false;
+  bool          perf_map     = false;
+  bool          jitdump      = false;
+  bool          async        = false;
+  bool          profile      = false;
+
+  for (int i = 1; i < argc; i ++) {
+    std::string arg = argv[i];
+    if ("--hash-consing" == arg) {
+      hash_consing = true;
+    } else if ("--jit" == arg) {
+      jit = true;
+    } else if ("--perf-map" == arg) {
+      jit = perf_map = true;
+    } else if ("--jitdump" == arg) {
+      jit = jitdump = true;
+    } else if ("--async" == arg) {
+      async = true;
+    } else if ("--profile" == arg) {
+      profile = true;
+    } else if (i + 1 >= argc) {
+      return usage(argv[0]);
+    } else if ("--server" == arg) {
+      socket_path = argv[++ i];
+    } else if ("--watch" == arg) {
+      watch_path = argv[++ i];
+    } else if ("--threads" == arg) {
+      n_threads = static_cast<unsigned>(atoi(argv[++ i]));
+    } else if ("--max-request-bytes" == arg) {
+      limits.max_request_bytes = static_cast<size_t>(atoll(argv[++ i]));
+    } else if ("--max-instructions" == arg) {
+      limits.max_instructions = static_cast<size_t>(atoll(argv[++ i]));
+    } else if ("--max-request-ms" == arg) {
+      limits.max_request_time = std::chrono::milliseconds(atoll(argv[++ i]));
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  // a watched file is compiled in the foreground, and not served
+  if (!watch_path.empty() && (async || !socket_path.empty())) {
+    std::cerr << "--watch cannot be used with --async or --server" << std::endl;
+    return usage(argv[0]);
+  }
+
+  if (!socket_path.empty()) {
+    Server s(socket_path, n_threads, limits);
+    server = &s;
+    signal(SIGINT, stop_server);
+    signal(SIGTERM, stop_server);
+    return s.run();
+  }
+
+  if (!watch_path.empty()) {
+    int ret = watch(watch_path, hash_consing, jit, perf_map, jitdump, profile);
+    if (profile) {
+      std::cerr << Profiler::get_instance().report();
+    }
+    return ret;
+  }
+
+  REPL::get_instance()->set_hash_consing(hash_consing);
+  if (jit) {
+    REPL::get_instance()->enable_jit(perf_map, jitdump);
+  }
+  if (async) {
+    REPL::get_instance()->enable_async();
+  }
+  if (profile) {
+    REPL::get_instance()->enable_profiling();
+  }
   REPL::get_instance()->run();
   REPL::release();
+  if (profile) {
+    std::cerr << Profiler::get_instance().report();
+  }
   return 0;
 }
\ No newline at end of file
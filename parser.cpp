@@ -1,3 +1,5 @@
+#include <cstring>
+#include <set>
 #include <llvm/ADT/STLExtras.h>
 #include "parser.h"
 
@@ -7,16 +9,43 @@ std::map<char, int> Parser::binops_prio = {
   #undef X
 };
 
-Parser::Parser(Lexer &lexer) : lexer(lexer) {}
+// pure_callees - builtins, which are assumed free of side effects, so that
+// calls to them can be shared, unless they are redefined
+static const std::set<std::string> pure_callees = {
+  #define X(a, b, c) #a,
+  BUILTIN_INFO
+  #undef X
+  "len"
+};
+
+Parser::Parser(Lexer &lexer, std::ostream &error_stream)
+  : lexer(lexer), error_stream(error_stream) {}
+
+// set_hash_consing - enables or disables hash consing, in which all
+// structurally identical pure subexpressions of a top level are parsed
+// to SharedExprASTs sharing one node
+void Parser::set_hash_consing(bool enabled) {
+  hash_consing = enabled;
+}
+
+// set_defined - takes name as defined (via "def") in an earlier input, so
+// that calls to it are not pure even if it is a builtin
+void Parser::set_defined(const std::string &name) {
+  defined.insert(name);
+}
 
 // parse_primary - parses primary
 // primary -> identifierexpr
 //          | numberexpr
 //          | parenexpr
+//          | varexpr
+//          | forexpr
 std::unique_ptr<ExprAST> Parser::parse_primary() {
   switch(lexer.get_curr_token()) {
   case Lexer::token_identifier: return parse_identifier_expr();
   case Lexer::token_numval:     return parse_number_expr();
+  case Lexer::token_var:        return parse_var_expr();
+  case Lexer::token_for:        return parse_for_expr();
   case '(':              return parse_paren_expr();
   default: return throw_error("unknown token when expecting an expression");
   }
@@ -27,7 +56,7 @@ std::unique_ptr<ExprAST> Parser::parse_primary() {
 std::unique_ptr<ExprAST> Parser::parse_number_expr() {
   std::unique_ptr<ExprAST> e = llvm::make_unique<NumberExprAST>(lexer.get_curr_numval());
   lexer.advance(); // eat numval
-  return e;
+  return intern(std::move(e));
 }
 
 // parse_paren_expr - parses parenexpr
@@ -49,15 +78,31 @@ std::unique_ptr<ExprAST> Parser::parse_paren_expr() {
 
 // parse_identifier_expr - parses identifierexpr
 // identifierexpr -> identifier
+//                 | identifier '[' expression ']'
 //                 | identifier '(' [expression (, expression)*] ')'
 std::unique_ptr<ExprAST> Parser::parse_identifier_expr() {
   std::string id = lexer.get_curr_identifier();
 
   lexer.advance(); // eat identifier
 
+  // an array indexing
+  if ('[' == lexer.get_curr_token()) {
+    lexer.advance(); // eat '['
+
+    auto index = parse_expression();
+    if (!index) { return nullptr; }
+
+    if (']' != lexer.get_curr_token()) {
+      return throw_error("expected ']'");
+    }
+    lexer.advance(); // eat ']'
+
+    return intern(llvm::make_unique<IndexExprAST>(id, std::move(index)));
+  }
+
   // an identifier
   if ('(' != lexer.get_curr_token()) {
-    return llvm::make_unique<VariableExprAST>(id);
+    return intern(llvm::make_unique<VariableExprAST>(id));
   }
 
   // a function invoking
@@ -80,7 +125,94 @@ std::unique_ptr<ExprAST> Parser::parse_identifier_expr() {
 
   lexer.advance(); // eat ')'
 
-  return llvm::make_unique<CallExprAST>(id, std::move(args));
+  return intern(llvm::make_unique<CallExprAST>(id, std::move(args)));
+}
+
+// parse_var_expr - parses varexpr
+// varexpr -> 'var' identifier ['=' expression]
+//                  (',' identifier ['=' expression])* 'in' expression
+std::unique_ptr<ExprAST> Parser::parse_var_expr() {
+  lexer.advance(); // eat 'var'
+
+  std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> vars;
+  while (1) {
+    if (lexer.get_curr_token() != Lexer::token_identifier) {
+      return throw_error("expected identifier after 'var'");
+    }
+
+    std::string name = lexer.get_curr_identifier();
+    lexer.advance(); // eat identifier
+
+    // the initializer is optional
+    std::unique_ptr<ExprAST> init;
+    if ('=' == lexer.get_curr_token()) {
+      lexer.advance(); // eat '='
+      init = parse_expression();
+      if (!init) { return nullptr; }
+    }
+    vars.push_back(std::make_pair(name, std::move(init)));
+
+    if (Lexer::token_in == lexer.get_curr_token()) {
+      break;
+    } else if (',' != lexer.get_curr_token()) {
+      return throw_error("expected ',' or 'in' after 'var'");
+    } else {
+      lexer.advance(); // eat ','
+    }
+  }
+  lexer.advance(); // eat 'in'
+
+  auto body = parse_expression();
+  if (!body) { return nullptr; }
+
+  return llvm::make_unique<VarExprAST>(std::move(vars), std::move(body));
+}
+
+// parse_for_expr - parses forexpr
+// forexpr -> 'for' identifier '=' expression ',' expression
+//                  [',' expression] 'in' expression
+std::unique_ptr<ExprAST> Parser::parse_for_expr() {
+  lexer.advance(); // eat 'for'
+
+  if (lexer.get_curr_token() != Lexer::token_identifier) {
+    return throw_error("expected identifier after 'for'");
+  }
+  std::string name = lexer.get_curr_identifier();
+  lexer.advance(); // eat identifier
+
+  if ('=' != lexer.get_curr_token()) {
+    return throw_error("expected '=' after 'for'");
+  }
+  lexer.advance(); // eat '='
+
+  auto start = parse_expression();
+  if (!start) { return nullptr; }
+
+  if (',' != lexer.get_curr_token()) {
+    return throw_error("expected ',' after for start value");
+  }
+  lexer.advance(); // eat ','
+
+  auto end = parse_expression();
+  if (!end) { return nullptr; }
+
+  // the step is optional
+  std::unique_ptr<ExprAST> step;
+  if (',' == lexer.get_curr_token()) {
+    lexer.advance(); // eat ','
+    step = parse_expression();
+    if (!step) { return nullptr; }
+  }
+
+  if (Lexer::token_in != lexer.get_curr_token()) {
+    return throw_error("expected 'in' after for");
+  }
+  lexer.advance(); // eat 'in'
+
+  auto body = parse_expression();
+  if (!body) { return nullptr; }
+
+  return llvm::make_unique<ForExprAST>(name, std::move(start), std::move(end), std::move(step), std::move(body));
 }
 
 // parse_expression - parses expression
@@ -121,18 +253,20 @@ std::unique_ptr<ExprAST> Parser::parse_binoprhs(int expr_prio, std::unique_ptr<E
     }
 
     // merge lhs/rhs to a binary expression
-    lhs = llvm::make_unique<BinaryExprAST>((char) binop, std::move(lhs), std::move(rhs));
+    lhs = intern(llvm::make_unique<BinaryExprAST>((char) binop, std::move(lhs), std::move(rhs)));
   }
 }
 
 // parse_prototype - parses prototype
-// prototype -> identifier '(' [identifier (, identifier)*] ')'
+// prototype -> identifier '(' [argument (, argument)*] ')'
+// argument  -> identifier | identifier '[' ']'
 std::unique_ptr<PrototypeAST> Parser::parse_prototype() {
   if (lexer.get_curr_token() != Lexer::token_identifier) {
     return throw_error_p("expected function name in prototype");
   }
 
   std::string fname = lexer.get_curr_identifier();
+  unsigned    line  = lexer.get_curr_line();
   lexer.advance(); // eat identifier
 
   if ('(' != lexer.get_curr_token()) {
@@ -141,6 +275,7 @@ std::unique_ptr<PrototypeAST> Parser::parse_prototype() {
   lexer.advance(); // eat '('
 
   std::vector<std::string> args;
+  std::vector<bool>        array_args;
   while (1) {
     if (lexer.get_curr_token() != Lexer::token_identifier) {
       return throw_error_p("expected function name in prototype");
@@ -149,6 +284,16 @@ std::unique_ptr<PrototypeAST> Parser::parse_prototype() {
     args.push_back(lexer.get_curr_identifier());
     lexer.advance(); // eat identifier
 
+    // an array argument
+    array_args.push_back('[' == lexer.get_curr_token());
+    if (array_args.back()) {
+      lexer.advance(); // eat '['
+      if (']' != lexer.get_curr_token()) {
+        return throw_error_p("expected ']' in prototype");
+      }
+      lexer.advance(); // eat ']'
+    }
+
     if (')' == lexer.get_curr_token()) {
       break;
     } else if (',' != lexer.get_curr_token()) {
@@ -159,7 +304,9 @@ std::unique_ptr<PrototypeAST> Parser::parse_prototype() {
   }
   lexer.advance(); // eat ')'
 
-  return llvm::make_unique<PrototypeAST>(fname, args);
+  auto proto = llvm::make_unique<PrototypeAST>(fname, args, array_args);
+  proto->line = line;
+  return proto;
 }
 
 // parse_definition - parses definition
@@ -169,6 +316,9 @@ std::unique_ptr<FunctionAST> Parser::parse_definition() {
 
   auto proto = parse_prototype();
   if (!proto) { return nullptr; }
+  // a builtin redefined is called rather than lowered from now on, so calls
+  // to it are no longer pure, even in its own body
+  defined.insert(proto->name);
 
   if ('{' != lexer.get_curr_token()) {
     return throw_error_f("expected '{' in function body");
@@ -200,16 +350,22 @@ std::unique_ptr<PrototypeAST> Parser::parse_external() {
 // parse_toplevelexpr - parses toplevelexpr
 // toplevelexpr -> expression
 std::unique_ptr<FunctionAST> Parser::parse_toplevelexpr() {
+  unsigned line = lexer.get_curr_line();
   auto e = parse_expression();
   if (!e) { return nullptr; }
 
   auto proto = llvm::make_unique<PrototypeAST>("", std::vector<std::string>());
+  proto->line = line;
   return llvm::make_unique<FunctionAST>(std::move(proto), std::move(e));
 }
 
 // parse_top - parses on line of input
 // top -> definition | external | toplevelexpr | ';'
 std::unique_ptr<AST> Parser::parse_top() {
+  // nodes are only shared within a top level
+  interned.clear();
+  intern_ids.clear();
+
   switch (lexer.get_curr_token()) {
   case ';':                 return nullptr;
   case Lexer::token_def:    return parse_definition();
@@ -218,20 +374,85 @@ std::unique_ptr<AST> Parser::parse_top() {
   }
 }
 
+// intern - gets the shared node of e if hash consing is enabled and e is
+// pure, otherwise e itself
+std::unique_ptr<ExprAST> Parser::intern(std::unique_ptr<ExprAST> e) {
+  std::string key;
+  if (!hash_consing || !get_intern_key(*e, key)) {
+    return e;
+  }
+
+  auto &shared = interned[key];
+  if (!shared) {
+    shared = std::move(e);
+    unsigned id = static_cast<unsigned>(intern_ids.size());
+    intern_ids[shared.get()] = id;
+  }
+
+  return llvm::make_unique<SharedExprAST>(shared);
+}
+
+// get_intern_key - gets the key identifying the structure of e, which is
+// made of the ids of its shared children, returns false if e is not pure
+bool Parser::get_intern_key(const ExprAST &e, std::string &key) {
+  // appends the id of a shared child to key, fails if the child is not shared
+  auto append_id = [this, &key](const std::unique_ptr<ExprAST> &child) {
+    auto *shared = dynamic_cast<SharedExprAST *>(child.get());
+    auto id = shared ? intern_ids.find(shared->expr.get()) : intern_ids.end();
+    if (intern_ids.end() == id) {
+      return false;
+    }
+    key += std::to_string(id->second) + ':';
+    return true;
+  };
+
+  if (auto *number = dynamic_cast<const NumberExprAST *>(&e)) {
+    // by bits, so that 0 and -0 differ
+    uint64_t bits;
+    memcpy(&bits, &number->val, sizeof(bits));
+    key = "n" + std::to_string(bits);
+    return true;
+  } else if (auto *var = dynamic_cast<const VariableExprAST *>(&e)) {
+    key = "v" + var->name;
+    return true;
+  } else if (auto *index = dynamic_cast<const IndexExprAST *>(&e)) {
+    key = "i" + index->name + ':';
+    return append_id(index->index);
+  } else if (auto *binary = dynamic_cast<const BinaryExprAST *>(&e)) {
+    // an assignment is never shared
+    key = std::string("b") + binary->op + ':';
+    return Lexer::operator_assign != binary->op && append_id(binary->lhs) && append_id(binary->rhs);
+  } else if (auto *call = dynamic_cast<const CallExprAST *>(&e)) {
+    if (!pure_callees.count(call->callee) || defined.count(call->callee)) {
+      return false;
+    }
+    key = "c" + call->callee + ':';
+    for (auto &arg : call->args) {
+      if (!append_id(arg)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  return false;
+}
+
 // get_binop_prio - get the priority of binop op, or -1
 int Parser::get_binop_prio(char op) {
   if (!isascii(op)) { return -1; }
 
-  int prio = binops_prio[op];
+  // never insert into binops_prio, parsers may run concurrently
+  auto prio = binops_prio.find(op);
   // priority of each operator is 1 at least
-  if (prio <= 0) { return -1; }
+  if (binops_prio.end() == prio || prio->second <= 0) { return -1; }
 
-  return prio;
+  return prio->second;
 }
 
 // throw_error
 std::unique_ptr<ExprAST> Parser::throw_error(const std::string &message) {
-  std::cerr << message << std::endl;
+  error_stream << message << std::endl;
   return nullptr;
 }
 
@@ -2,6 +2,8 @@
 #define __KLANG_PARSER_H__
 
 #include <map>
+#include <set>
+#include <string>
 #include <memory>
 #include "lexer.h"
 #include "ast.h"
@@ -12,11 +14,21 @@ public:
   static std::map<char, int> binops_prio;
 
 public:
-  Parser(Lexer &lexer);
+  // a Parser reports errors to error_stream
+  Parser(Lexer &lexer, std::ostream &error_stream = std::cerr);
+  // set_hash_consing - enables or disables hash consing, in which all
+  // structurally identical pure subexpressions of a top level are parsed
+  // to SharedExprASTs sharing one node
+  void set_hash_consing(bool enabled);
+  // set_defined - takes name as defined (via "def") in an earlier input, so
+  // that calls to it are not pure even if it is a builtin
+  void set_defined(const std::string &name);
   // parse_primary - parses primary
   // primary -> identifierexpr
   //          | numberexpr
   //          | parenexpr
+  //          | varexpr
+  //          | forexpr
   std::unique_ptr<ExprAST> parse_primary();
   // parse_number_expr - parses numberexpr
   // numberexpr -> numval
@@ -26,8 +38,17 @@ public:
   std::unique_ptr<ExprAST> parse_paren_expr();
   // parse_identifier_expr - parses identifierexpr
   // identifierexpr -> identifier
+  //                 | identifier '[' expression ']'
   //                 | identifier '(' [expression (, expression)*] ')'
   std::unique_ptr<ExprAST> parse_identifier_expr();
+  // parse_var_expr - parses varexpr
+  // varexpr -> 'var' identifier ['=' expression]
+  //                  (',' identifier ['=' expression])* 'in' expression
+  std::unique_ptr<ExprAST> parse_var_expr();
+  // parse_for_expr - parses forexpr
+  // forexpr -> 'for' identifier '=' expression ',' expression
+  //                  [',' expression] 'in' expression
+  std::unique_ptr<ExprAST> parse_for_expr();
   // parse_expression - parses expression
   // expression -> primary binoprhs
   std::unique_ptr<ExprAST> parse_expression();
@@ -35,7 +56,8 @@ public:
   // binoprhs -> ( binop primary )*
   std::unique_ptr<ExprAST> parse_binoprhs(int expr_prio, std::unique_ptr<ExprAST> rhs);
   // parse_prototype - parses prototype
-  // prototype -> identifier '(' [identifier (, identifier)*] ')'
+  // prototype -> identifier '(' [argument (, argument)*] ')'
+  // argument  -> identifier | identifier '[' ']'
   std::unique_ptr<PrototypeAST> parse_prototype();
   // parse_definition - parses definition
   // definition -> 'def' prototype '{' expression '}'
@@ -51,6 +73,12 @@ public:
   std::unique_ptr<AST> parse_top();
 
 private:
+  // intern - gets the shared node of e if hash consing is enabled and e is
+  // pure, otherwise e itself
+  std::unique_ptr<ExprAST> intern(std::unique_ptr<ExprAST> e);
+  // get_intern_key - gets the key identifying the structure of e, which is
+  // made of the ids of its shared children, returns false if e is not pure
+  bool get_intern_key(const ExprAST &e, std::string &key);
   // get_binop_prio - get the priority of binop op, or -1
   int get_binop_prio(char op);
   // throw_error
@@ -61,7 +89,15 @@ private:
   std::unique_ptr<FunctionAST> throw_error_f(const std::string &message);
 
 private:
-  Lexer &lexer;
+  Lexer        &lexer;
+  std::ostream &error_stream;
+  bool          hash_consing = false;
+  // interned maps the key of each shared node to it, and intern_ids maps
+  // each shared node to its id, both are reset for each top level
+  std::map<std::string, std::shared_ptr<ExprAST>> interned;
+  std::map<const ExprAST *, unsigned>             intern_ids;
+  // defined are the names of all functions defined (via "def")
+  std::set<std::string>                           defined;
 
 };
 
@@ -0,0 +1,236 @@
+#include <cstring>
+#include <ctime>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <llvm/Object/SymbolSize.h>
+#include "perf_map.h"
+
+// jitdump format, see tools/perf/Documentation/jitdump-specification.txt
+// in the linux kernel sources
+namespace {
+
+enum {
+  JITDUMP_MAGIC      = 0x4A695444,
+  JITDUMP_VERSION    = 1,
+  JIT_CODE_LOAD      = 0,
+  JIT_CODE_DEBUG_INFO = 2,
+};
+
+struct JitdumpHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t total_size;
+  uint32_t elf_mach;
+  uint32_t pad1;
+  uint32_t pid;
+  uint64_t timestamp;
+  uint64_t flags;
+};
+
+struct JitdumpRecordHeader {
+  uint32_t id;
+  uint32_t total_size;
+  uint64_t timestamp;
+};
+
+struct JitdumpCodeLoad {
+  JitdumpRecordHeader header;
+  uint32_t            pid;
+  uint32_t            tid;
+  uint64_t            vma;
+  uint64_t            code_addr;
+  uint64_t            code_size;
+  uint64_t            code_index;
+  // followed by the name, and the codes
+};
+
+struct JitdumpDebugInfo {
+  JitdumpRecordHeader header;
+  uint64_t            code_addr;
+  uint64_t            nr_entry;
+  // followed by nr_entry JitdumpDebugEntry
+};
+
+struct JitdumpDebugEntry {
+  uint64_t addr;
+  uint32_t lineno;
+  uint32_t discrim;
+  // followed by the file name
+};
+
+// timestamp - the clock perf uses with `perf record -k 1`
+uint64_t timestamp() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// elf_mach - the ELF machine of the host
+uint32_t elf_mach() {
+#if defined(__x86_64__)
+  return EM_X86_64;
+#elif defined(__i386__)
+  return EM_386;
+#elif defined(__aarch64__)
+  return EM_AARCH64;
+#elif defined(__arm__)
+  return EM_ARM;
+#else
+  return EM_NONE;
+#endif
+}
+
+} // namespace
+
+PerfMapListener::PerfMapListener(bool jitdump) {
+  std::string path = "/tmp/perf-" + std::to_string(getpid()) + ".map";
+  perf_map = fopen(path.c_str(), "a");
+
+  if (jitdump && !open_jitdump()) {
+    perror("cannot open jitdump");
+  }
+}
+
+PerfMapListener::~PerfMapListener() {
+  if (perf_map) {
+    fclose(perf_map);
+  }
+  if (jitdump_mark) {
+    munmap(jitdump_mark, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+  }
+  if (jitdump) {
+    fclose(jitdump);
+  }
+}
+
+// set_location - sets the source location of the function with symbol
+void PerfMapListener::set_location(const std::string &symbol, const std::string &name,
+                                   const std::string &file, unsigned line) {
+  std::lock_guard<std::mutex> lock(mutex);
+  locations[symbol] = {name, file, line};
+}
+
+// NotifyObjectEmitted - records all functions of an emitted object
+void PerfMapListener::NotifyObjectEmitted(const llvm::object::ObjectFile &obj,
+                                          const llvm::RuntimeDyld::LoadedObjectInfo &info) {
+  // the debug object has its sections at their load addresses
+  llvm::object::OwningBinary<llvm::object::ObjectFile> debug_owner = info.getObjectForDebug(obj);
+  const llvm::object::ObjectFile &debug_obj = *debug_owner.getBinary();
+
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const auto &sym_size : llvm::object::computeSymbolSizes(debug_obj)) {
+    llvm::object::SymbolRef sym = sym_size.first;
+    if (sym.getType() != llvm::object::SymbolRef::ST_Function) {
+      continue;
+    }
+
+    llvm::ErrorOr<llvm::StringRef> symbol = sym.getName();
+    llvm::ErrorOr<uint64_t>        addr   = sym.getAddress();
+    if (!symbol || !addr || 0 == sym_size.second) {
+      continue;
+    }
+
+    // perf shows the klang name and source location if known
+    auto l = locations.find(symbol->str());
+    const Location *location = locations.end() == l ? nullptr : &l->second;
+    std::string name = symbol->str();
+    if (location) {
+      name = location->name + " [" + location->file + ":" + std::to_string(location->line) + "]";
+    }
+
+    // the codes are not relocated yet, so they are copied to the jitdump
+    // once finalized, see flush_jitdump
+    write_perf_map(*addr, sym_size.second, name);
+    if (jitdump) {
+      code_loads.push_back({*addr, sym_size.second, name, nullptr != location, location ? *location : Location()});
+    }
+  }
+}
+
+// flush_jitdump - writes the jitdump records of the functions emitted since
+// the last call, whose codes must be finalized (relocated) by now
+void PerfMapListener::flush_jitdump() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &code_load : code_loads) {
+    write_jitdump(code_load.addr, code_load.size, code_load.name, code_load.has_location ? &code_load.location : nullptr);
+  }
+  code_loads.clear();
+}
+
+// write_perf_map - writes a perf map entry
+void PerfMapListener::write_perf_map(uint64_t addr, uint64_t size, const std::string &name) {
+  if (!perf_map) {
+    return;
+  }
+  fprintf(perf_map, "%llx %llx %s\n",
+          static_cast<unsigned long long>(addr), static_cast<unsigned long long>(size), name.c_str());
+  fflush(perf_map);
+}
+
+// write_jitdump - writes jitdump debug info and code load records
+void PerfMapListener::write_jitdump(uint64_t addr, uint64_t size, const std::string &name, const Location *location) {
+  // debug info must precede the code load it describes
+  if (location) {
+    JitdumpDebugInfo  debug_info;
+    JitdumpDebugEntry entry;
+    debug_info.header.id         = JIT_CODE_DEBUG_INFO;
+    debug_info.header.total_size = static_cast<uint32_t>(sizeof(debug_info) + sizeof(entry) + location->file.size() + 1);
+    debug_info.header.timestamp  = timestamp();
+    debug_info.code_addr         = addr;
+    debug_info.nr_entry          = 1;
+    entry.addr    = addr;
+    entry.lineno  = location->line;
+    entry.discrim = 0;
+    fwrite(&debug_info, sizeof(debug_info), 1, jitdump);
+    fwrite(&entry, sizeof(entry), 1, jitdump);
+    fwrite(location->file.c_str(), location->file.size() + 1, 1, jitdump);
+  }
+
+  JitdumpCodeLoad code_load;
+  code_load.header.id         = JIT_CODE_LOAD;
+  code_load.header.total_size = static_cast<uint32_t>(sizeof(code_load) + name.size() + 1 + size);
+  code_load.header.timestamp  = timestamp();
+  code_load.pid               = static_cast<uint32_t>(getpid());
+  code_load.tid               = static_cast<uint32_t>(syscall(SYS_gettid));
+  code_load.vma               = addr;
+  code_load.code_addr         = addr;
+  code_load.code_size         = size;
+  code_load.code_index        = code_index ++;
+  fwrite(&code_load, sizeof(code_load), 1, jitdump);
+  fwrite(name.c_str(), name.size() + 1, 1, jitdump);
+  fwrite(reinterpret_cast<const void *>(addr), static_cast<size_t>(size), 1, jitdump);
+  fflush(jitdump);
+}
+
+// open_jitdump - opens the jitdump and writes its header, returns false if failed
+bool PerfMapListener::open_jitdump() {
+  std::string path = "/tmp/jit-" + std::to_string(getpid()) + ".dump";
+  jitdump = fopen(path.c_str(), "w+");
+  if (!jitdump) {
+    return false;
+  }
+
+  // perf finds the jitdump by this executable mapping of it
+  long page_size = sysconf(_SC_PAGESIZE);
+  jitdump_mark = mmap(nullptr, static_cast<size_t>(page_size), PROT_READ | PROT_EXEC, MAP_PRIVATE, fileno(jitdump), 0);
+  if (MAP_FAILED == jitdump_mark) {
+    jitdump_mark = nullptr;
+    fclose(jitdump);
+    jitdump = nullptr;
+    return false;
+  }
+
+  JitdumpHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic      = JITDUMP_MAGIC;
+  header.version    = JITDUMP_VERSION;
+  header.total_size = sizeof(header);
+  header.elf_mach   = elf_mach();
+  header.pid        = static_cast<uint32_t>(getpid());
+  header.timestamp  = timestamp();
+  fwrite(&header, sizeof(header), 1, jitdump);
+  fflush(jitdump);
+  return true;
+}
@@ -0,0 +1,67 @@
+#ifndef __KLANG_PERF_MAP_H__
+#define __KLANG_PERF_MAP_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <llvm/ExecutionEngine/JITEventListener.h>
+
+// PerfMapListener - a JITEventListener that makes jitted functions visible to
+// linux perf: it appends "start size name" lines to /tmp/perf-<pid>.map, and
+// optionally writes a jitdump /tmp/jit-<pid>.dump to be used by
+// `perf inject --jit` (record with `perf record -k 1`), which also carries
+// the source location of each function
+class PerfMapListener : public llvm::JITEventListener {
+public:
+  PerfMapListener(bool jitdump);
+  ~PerfMapListener();
+  // set_location - sets the source location of the function with symbol
+  void set_location(const std::string &symbol, const std::string &name,
+                    const std::string &file, unsigned line);
+  // NotifyObjectEmitted - records all functions of an emitted object
+  void NotifyObjectEmitted(const llvm::object::ObjectFile &obj,
+                           const llvm::RuntimeDyld::LoadedObjectInfo &info) override;
+  // flush_jitdump - writes the jitdump records of the functions emitted
+  // since the last call, whose codes must be finalized (relocated) by now
+  void flush_jitdump();
+
+private:
+  // Location - the klang name and source location of a function
+  struct Location {
+    std::string name;
+    std::string file;
+    unsigned    line;
+  };
+
+  // CodeLoad - a function emitted, whose jitdump records are not written yet
+  struct CodeLoad {
+    uint64_t    addr;
+    uint64_t    size;
+    std::string name;
+    bool        has_location;
+    Location    location;
+  };
+
+private:
+  // write_perf_map - writes a perf map entry
+  void write_perf_map(uint64_t addr, uint64_t size, const std::string &name);
+  // write_jitdump - writes jitdump debug info and code load records
+  void write_jitdump(uint64_t addr, uint64_t size, const std::string &name, const Location *location);
+  // open_jitdump - opens the jitdump and writes its header, returns false if failed
+  bool open_jitdump();
+
+private:
+  std::mutex                      mutex;
+  std::map<std::string, Location> locations;
+  std::vector<CodeLoad>           code_loads;
+  FILE                           *perf_map     = nullptr;
+  FILE                           *jitdump      = nullptr;
+  void                           *jitdump_mark = nullptr;
+  uint64_t                        code_index   = 0;
+};
+
+#endif
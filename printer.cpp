@@ -0,0 +1,102 @@
+#include <iomanip>
+#include <limits>
+#include "printer.h"
+
+// visit - prints NumberExprAST
+void ASTPrinter::visit(const NumberExprAST &ast) {
+  out << std::setprecision(std::numeric_limits<double>::max_digits10) << ast.val;
+}
+
+// visit - prints VariableExprAST
+void ASTPrinter::visit(const VariableExprAST &ast) {
+  out << ast.name;
+}
+
+// visit - prints IndexExprAST
+void ASTPrinter::visit(const IndexExprAST &ast) {
+  out << ast.name << '[';
+  ast.index->accept(*this);
+  out << ']';
+}
+
+// visit - prints BinaryExprAST
+void ASTPrinter::visit(const BinaryExprAST &ast) {
+  out << '(';
+  ast.lhs->accept(*this);
+  out << ' ' << ast.op << ' ';
+  ast.rhs->accept(*this);
+  out << ')';
+}
+
+// visit - prints CallExprAST
+void ASTPrinter::visit(const CallExprAST &ast) {
+  out << ast.callee << '(';
+  for (unsigned i = 0, e = static_cast<unsigned>(ast.args.size()); i < e; i ++) {
+    if (i) { out << ", "; }
+    ast.args[i]->accept(*this);
+  }
+  out << ')';
+}
+
+// visit - prints SharedExprAST, the same as the expression it shares
+void ASTPrinter::visit(const SharedExprAST &ast) {
+  ast.expr->accept(*this);
+}
+
+// visit - prints VarExprAST
+void ASTPrinter::visit(const VarExprAST &ast) {
+  out << "(var ";
+  for (unsigned i = 0, e = static_cast<unsigned>(ast.vars.size()); i < e; i ++) {
+    if (i) { out << ", "; }
+    out << ast.vars[i].first;
+    if (ast.vars[i].second) {
+      out << " = ";
+      ast.vars[i].second->accept(*this);
+    }
+  }
+  out << " in ";
+  ast.body->accept(*this);
+  out << ')';
+}
+
+// visit - prints ForExprAST
+void ASTPrinter::visit(const ForExprAST &ast) {
+  out << "(for " << ast.var << " = ";
+  ast.start->accept(*this);
+  out << ", ";
+  ast.end->accept(*this);
+  if (ast.step) {
+    out << ", ";
+    ast.step->accept(*this);
+  }
+  out << " in ";
+  ast.body->accept(*this);
+  out << ')';
+}
+
+// visit - prints PrototypeAST
+void ASTPrinter::visit(const PrototypeAST &ast) {
+  out << ast.name << '(';
+  for (unsigned i = 0, e = static_cast<unsigned>(ast.args.size()); i < e; i ++) {
+    if (i) { out << ", "; }
+    out << ast.args[i];
+    if (ast.is_array_arg(i)) { out << "[]"; }
+  }
+  out << ')';
+}
+
+// visit - prints FunctionAST
+void ASTPrinter::visit(const FunctionAST &ast) {
+  out << "def ";
+  ast.proto->accept(*this);
+  out << " { ";
+  ast.body->accept(*this);
+  out << " }";
+}
+
+// get_ret_str - gets the printed string, and resets the printer
+std::string ASTPrinter::get_ret_str() {
+  std::string s = out.str();
+  out.str("");
+  return s;
+}
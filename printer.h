@@ -0,0 +1,39 @@
+#ifndef __KLANG_PRINTER_H__
+#define __KLANG_PRINTER_H__
+
+#include <string>
+#include <sstream>
+#include "ast.h"
+
+// ASTPrinter - ASTPrinter is a visitor that prints an AST in a canonical
+// form, two ASTs are structurally identical iff their canonical forms equal
+class ASTPrinter : public Visitor {
+public:
+  // visit - prints NumberExprAST
+  void visit(const NumberExprAST &ast) override;
+  // visit - prints VariableExprAST
+  void visit(const VariableExprAST &ast) override;
+  // visit - prints IndexExprAST
+  void visit(const IndexExprAST &ast) override;
+  // visit - prints BinaryExprAST
+  void visit(const BinaryExprAST &ast) override;
+  // visit - prints CallExprAST
+  void visit(const CallExprAST &ast) override;
+  // visit - prints SharedExprAST, the same as the expression it shares
+  void visit(const SharedExprAST &ast) override;
+  // visit - prints VarExprAST
+  void visit(const VarExprAST &ast) override;
+  // visit - prints ForExprAST
+  void visit(const ForExprAST &ast) override;
+  // visit - prints PrototypeAST
+  void visit(const PrototypeAST &ast) override;
+  // visit - prints FunctionAST
+  void visit(const FunctionAST &ast) override;
+  // get_ret_str - gets the printed string, and resets the printer
+  std::string get_ret_str();
+
+private:
+  std::ostringstream out;
+};
+
+#endif
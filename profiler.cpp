@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "profiler.h"
+
+// thread_profile - the profile of the calling thread, owned by the profiler
+static thread_local void *thread_profile = nullptr;
+
+// add - adds n to a counter only written by the calling thread, which needs
+// no atomic read-modify-write
+static void add(std::atomic<uint64_t> &counter, uint64_t n) {
+  counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// get_instance - gets the process-wide profiler
+Profiler &Profiler::get_instance() {
+  static Profiler instance;
+  return instance;
+}
+
+Profiler::Profiler()
+  : start_cycles(get_cycles()),
+    start_time(std::chrono::steady_clock::now()) {}
+
+// get_id - gets the id of the function named name
+unsigned Profiler::get_id(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto i = ids.find(name);
+  if (ids.end() != i) {
+    return i->second;
+  }
+
+  unsigned id = static_cast<unsigned>(names.size());
+  names.push_back(name);
+  ids[name] = id;
+  return id;
+}
+
+// enter - records that the calling thread enters function id
+void Profiler::enter(unsigned id) {
+  ThreadProfile &t = get_thread_profile();
+  if (t.flat.size() <= id) {
+    std::lock_guard<std::mutex> lock(t.mutex);
+    while (t.flat.size() <= id) {
+      t.flat.push_back(std::unique_ptr<Flat>(new Flat()));
+    }
+  }
+  t.flat[id]->depth ++;
+
+  Node *parent = t.stack.empty() ? &t.root : t.stack.back().node;
+  t.stack.push_back({parent->get_child(id, &t.mutex), 0, 0});
+  t.stack.back().start = get_cycles();
+}
+
+// exit - records that the calling thread exits function id
+void Profiler::exit(unsigned id) {
+  uint64_t end = get_cycles();
+  ThreadProfile &t = get_thread_profile();
+  if (t.stack.empty() || t.stack.back().node->id != id) {
+    return; // not entered while profiling
+  }
+
+  Frame frame = t.stack.back();
+  t.stack.pop_back();
+  uint64_t elapsed = end - frame.start;
+  add(frame.node->calls, 1);
+  add(frame.node->total, elapsed);
+  add(frame.node->self, elapsed - frame.children);
+  if (!t.stack.empty()) {
+    t.stack.back().children += elapsed;
+  }
+
+  Flat &flat = *t.flat[id];
+  add(flat.calls, 1);
+  add(flat.self, elapsed - frame.children);
+  if (0 == -- flat.depth) {
+    add(flat.total, elapsed);
+  }
+}
+
+// report - reports the flat profile, by self time, and the call tree, by
+// total time, of all threads
+std::string Profiler::report() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+  double cycles_per_ms = ms > 0 ? (get_cycles() - start_cycles) / ms : 1;
+
+  Node tree;
+  std::vector<Flat> flat(names.size());
+  for (auto &t : threads) {
+    std::lock_guard<std::mutex> thread_lock(t->mutex);
+    merge(tree, t->root);
+    for (size_t id = 0; id < t->flat.size() && id < flat.size(); id ++) {
+      add(flat[id].calls, t->flat[id]->calls.load(std::memory_order_relaxed));
+      add(flat[id].total, t->flat[id]->total.load(std::memory_order_relaxed));
+      add(flat[id].self, t->flat[id]->self.load(std::memory_order_relaxed));
+    }
+  }
+
+  std::vector<unsigned> order;
+  for (unsigned id = 0; id < flat.size(); id ++) {
+    if (flat[id].calls) {
+      order.push_back(id);
+    }
+  }
+  std::sort(order.begin(), order.end(), [&flat](unsigned a, unsigned b) {
+    return flat[a].self > flat[b].self;
+  });
+
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3);
+  out << "flat profile, by self time:" << std::endl
+      << std::setw(12) << "calls" << std::setw(12) << "total ms" << std::setw(12) << "self ms" << "  function" << std::endl;
+  for (unsigned id : order) {
+    out << std::setw(12) << flat[id].calls
+        << std::setw(12) << flat[id].total / cycles_per_ms
+        << std::setw(12) << flat[id].self / cycles_per_ms << "  " << names[id] << std::endl;
+  }
+
+  out << "call tree, by total time:" << std::endl
+      << std::setw(12) << "calls" << std::setw(12) << "total ms" << std::setw(12) << "self ms" << "  function" << std::endl;
+  print_tree(out, tree, 0, cycles_per_ms);
+  return out.str();
+}
+
+// get_child - gets the child for function id, adding it if missing, under
+// mutex if not nullptr
+Profiler::Node *Profiler::Node::get_child(unsigned id, std::mutex *mutex) {
+  for (auto &child : children) {
+    if (child->id == id) {
+      return child.get();
+    }
+  }
+
+  std::unique_lock<std::mutex> lock;
+  if (mutex) {
+    lock = std::unique_lock<std::mutex>(*mutex);
+  }
+  children.push_back(std::unique_ptr<Node>(new Node()));
+  children.back()->id = id;
+  return children.back().get();
+}
+
+// get_thread_profile - gets the profile of the calling thread
+Profiler::ThreadProfile &Profiler::get_thread_profile() {
+  if (!thread_profile) {
+    std::lock_guard<std::mutex> lock(mutex);
+    threads.push_back(std::unique_ptr<ThreadProfile>(new ThreadProfile()));
+    thread_profile = threads.back().get();
+  }
+  return *static_cast<ThreadProfile *>(thread_profile);
+}
+
+// merge - merges the children of from into into, which is only read by the
+// calling thread
+void Profiler::merge(Node &into, const Node &from) {
+  for (auto &child : from.children) {
+    Node *node = into.get_child(child->id, nullptr);
+    add(node->calls, child->calls.load(std::memory_order_relaxed));
+    add(node->total, child->total.load(std::memory_order_relaxed));
+    add(node->self, child->self.load(std::memory_order_relaxed));
+    merge(*node, *child);
+  }
+}
+
+// print_tree - prints the children of node, by total time, at depth
+void Profiler::print_tree(std::ostream &out, const Node &node, unsigned depth, double cycles_per_ms) {
+  std::vector<const Node *> children;
+  for (auto &child : node.children) {
+    if (child->calls) {
+      children.push_back(child.get());
+    }
+  }
+  std::sort(children.begin(), children.end(), [](const Node *a, const Node *b) {
+    return a->total > b->total;
+  });
+
+  for (auto *child : children) {
+    out << std::setw(12) << child->calls
+        << std::setw(12) << child->total / cycles_per_ms
+        << std::setw(12) << child->self / cycles_per_ms << "  "
+        << std::string(2 * depth, ' ') << names[child->id] << std::endl;
+    print_tree(out, *child, depth + 1, cycles_per_ms);
+  }
+}
+
+// get_cycles - gets a timestamp in cycles, or nanoseconds if there is no
+// cycle counter
+uint64_t Profiler::get_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// klang_prof_enter - records entering the function of id
+void klang_prof_enter(int64_t id) {
+  Profiler::get_instance().enter(static_cast<unsigned>(id));
+}
+
+// klang_prof_exit - records exiting the function of id
+void klang_prof_exit(int64_t id) {
+  Profiler::get_instance().exit(static_cast<unsigned>(id));
+}
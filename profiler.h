@@ -0,0 +1,103 @@
+#ifndef __KLANG_PROFILER_H__
+#define __KLANG_PROFILER_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Profiler - counts calls of, and cycles spent in, each klang function that
+// is instrumented with enter and exit. each thread records into a call tree
+// and a flat profile of its own, which are merged in a report. counters are
+// atomics only written by their thread, and the tree and the flat profile
+// only grow under a lock of their thread, which a report takes to read them.
+// a report taken while functions run is approximate.
+class Profiler {
+public:
+  // get_instance - gets the process-wide profiler
+  static Profiler &get_instance();
+
+public:
+  Profiler();
+  // get_id - gets the id of the function named name
+  unsigned get_id(const std::string &name);
+  // enter - records that the calling thread enters function id
+  void enter(unsigned id);
+  // exit - records that the calling thread exits function id
+  void exit(unsigned id);
+  // report - reports the flat profile, by self time, and the call tree, by
+  // total time, of all threads
+  std::string report();
+
+private:
+  // Node - a function called along a path of the call tree
+  struct Node {
+    unsigned                           id     = 0;
+    std::atomic<uint64_t>              calls{0};
+    std::atomic<uint64_t>              total{0}; // cycles, including callees
+    std::atomic<uint64_t>              self{0};  // cycles, excluding callees
+    std::vector<std::unique_ptr<Node>> children;
+
+    // get_child - gets the child for function id, adding it if missing, under
+    // mutex if not nullptr
+    Node *get_child(unsigned id, std::mutex *mutex);
+  };
+
+  // Frame - a call in flight
+  struct Frame {
+    Node     *node;
+    uint64_t  start;
+    uint64_t  children; // cycles spent in callees
+  };
+
+  // Flat - the totals of a function, a recursive call only counts in the
+  // total time of the outermost one
+  struct Flat {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> self{0};
+    unsigned              depth = 0; // calls in flight, only read by the thread
+  };
+
+  // ThreadProfile - the profile of a thread, the stack is only read by the
+  // thread, root and flat by reports too
+  struct ThreadProfile {
+    std::mutex                         mutex; // taken to grow root or flat
+    Node                               root;
+    std::vector<Frame>                 stack;
+    std::vector<std::unique_ptr<Flat>> flat;  // indexed by function id
+  };
+
+private:
+  // get_thread_profile - gets the profile of the calling thread
+  ThreadProfile &get_thread_profile();
+  // merge - merges the children of from into into
+  static void merge(Node &into, const Node &from);
+  // print_tree - prints the children of node, by total time, at depth
+  void print_tree(std::ostream &out, const Node &node, unsigned depth, double cycles_per_ms);
+  // get_cycles - gets a timestamp in cycles, or nanoseconds if there is no
+  // cycle counter
+  static uint64_t get_cycles();
+
+private:
+  std::mutex                                  mutex;
+  std::map<std::string, unsigned>             ids;
+  std::vector<std::string>                    names;
+  std::vector<std::unique_ptr<ThreadProfile>> threads;
+  // timestamps the profiler is created at, to convert cycles to time
+  uint64_t                                    start_cycles;
+  std::chrono::steady_clock::time_point       start_time;
+};
+
+extern "C" {
+// klang_prof_enter - records entering the function of id
+void klang_prof_enter(int64_t id);
+// klang_prof_exit - records exiting the function of id
+void klang_prof_exit(int64_t id);
+}
+
+#endif
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <cmath>
+#include "runtime.h"
+
+// CHUNK_SIZE - indices per chunk of a parallel builtin, chunks are fixed so
+// that partial results are combined in the same order on any machine
+static const int64_t CHUNK_SIZE = 1024;
+
+// MAX_INDEX - the bound of the indices of a parallel builtin, beyond which
+// doubles do not count integers exactly any more
+static const double MAX_INDEX = 9007199254740992.0; // 2^53
+
+// worker_index - the deque index of a scheduler thread, or -1
+static thread_local int worker_index = -1;
+
+// get_instance - gets the process-wide scheduler, one thread per core
+Scheduler &Scheduler::get_instance() {
+  static Scheduler instance(std::max(1u, std::thread::hardware_concurrency()));
+  return instance;
+}
+
+Scheduler::Scheduler(unsigned n_threads)
+  : n_tasks(0) {
+  for (unsigned i = 0; i <= n_threads; i ++) {
+    deques.push_back(std::unique_ptr<Deque>(new Deque()));
+  }
+  for (unsigned i = 0; i < n_threads; i ++) {
+    threads.emplace_back(&Scheduler::work, this, i);
+  }
+}
+
+Scheduler::~Scheduler() {
+  {
+    std::lock_guard<std::mutex> lock(idle_mutex);
+    stopping = true;
+  }
+  idle_cond.notify_all();
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+// parallel_for - runs body(i) for each i in [0, n), returns when all done,
+// the calling thread helps running tasks meanwhile, so it may be nested
+void Scheduler::parallel_for(int64_t n, const std::function<void(int64_t)> &body) {
+  if (n <= 0) {
+    return;
+  }
+  if (1 == n) {
+    body(0);
+    return;
+  }
+
+  Job job;
+  job.body = &body;
+  job.remaining = n;
+
+  unsigned self = get_self();
+  run(self, {&job, 0, n});
+
+  // help until all tasks of the job are done, tasks of other jobs may be run
+  Task task;
+  while (job.remaining.load(std::memory_order_acquire) > 0) {
+    if (pop_or_steal(self, task)) {
+      run(self, task);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+// work - the loop run by each thread
+void Scheduler::work(unsigned self) {
+  worker_index = static_cast<int>(self);
+
+  Task task;
+  while (1) {
+    if (pop_or_steal(self, task)) {
+      run(self, task);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(idle_mutex);
+    idle_cond.wait(lock, [this] { return stopping || n_tasks.load() > 0; });
+    if (stopping) {
+      return;
+    }
+  }
+}
+
+// push - pushes a task to the deque of self
+void Scheduler::push(unsigned self, const Task &task) {
+  {
+    std::lock_guard<std::mutex> lock(deques[self]->mutex);
+    deques[self]->tasks.push_back(task);
+  }
+  n_tasks ++;
+
+  // idle_mutex orders the increment before a sleeping thread's check
+  { std::lock_guard<std::mutex> lock(idle_mutex); }
+  idle_cond.notify_one();
+}
+
+// pop_or_steal - pops a task of self, or steals one, returns false if none
+bool Scheduler::pop_or_steal(unsigned self, Task &task) {
+  if (n_tasks.load() <= 0) {
+    return false;
+  }
+
+  {
+    Deque &own = *deques[self];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = own.tasks.back();
+      own.tasks.pop_back();
+      n_tasks --;
+      return true;
+    }
+  }
+
+  // steal the oldest, thus largest, task of a victim
+  unsigned n = static_cast<unsigned>(deques.size());
+  for (unsigned i = 1; i < n; i ++) {
+    Deque &victim = *deques[(self + i) % n];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = victim.tasks.front();
+      victim.tasks.pop_front();
+      n_tasks --;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// run - runs a task, splitting it in halves until a single index is left
+void Scheduler::run(unsigned self, Task task) {
+  while (task.end - task.begin > 1) {
+    int64_t mid = task.begin + (task.end - task.begin) / 2;
+    push(self, {task.job, mid, task.end});
+    task.end = mid;
+  }
+
+  (*task.job->body)(task.begin);
+  task.job->remaining.fetch_sub(1, std::memory_order_release);
+}
+
+// get_self - gets the deque index of the calling thread
+unsigned Scheduler::get_self() {
+  if (worker_index >= 0) {
+    return static_cast<unsigned>(worker_index);
+  }
+  // all external threads share the last deque
+  return static_cast<unsigned>(deques.size() - 1);
+}
+
+// to_index - converts a bound of a range of indices to the first integer not
+// below it, clamped to [-MAX_INDEX, MAX_INDEX], the bound must be finite
+static int64_t to_index(double bound) {
+  return static_cast<int64_t>(std::min(MAX_INDEX, std::max(-MAX_INDEX, std::ceil(bound))));
+}
+
+// klang_parallel_sum - sums fn(i) for each integer i in [lo, hi), the result
+// does not depend on the number of threads
+double klang_parallel_sum(klang_fn fn, double lo, double hi) {
+  // a range with a nan or infinite bound is empty
+  if (!std::isfinite(lo) || !std::isfinite(hi)) {
+    return 0;
+  }
+  int64_t begin = to_index(lo);
+  int64_t end   = to_index(hi);
+  if (end <= begin) {
+    return 0;
+  }
+
+  int64_t n_chunks = (end - begin + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  std::vector<double> partials(static_cast<size_t>(n_chunks), 0);
+
+  Scheduler::get_instance().parallel_for(n_chunks, [&](int64_t c) {
+    int64_t chunk_begin = begin + c * CHUNK_SIZE;
+    int64_t chunk_end   = std::min(end, chunk_begin + CHUNK_SIZE);
+    double  partial     = 0;
+    for (int64_t i = chunk_begin; i < chunk_end; i ++) {
+      partial += fn(static_cast<double>(i));
+    }
+    partials[static_cast<size_t>(c)] = partial;
+  });
+
+  // combine partials in chunk order, so that the sum is deterministic
+  double sum = 0;
+  for (double partial : partials) {
+    sum += partial;
+  }
+  return sum;
+}
+
+// klang_parallel_map - stores fn(i) into out[i] for each integer i in
+// [lo, hi), which must be in [0, len), returns the number of stored values
+double klang_parallel_map(klang_fn fn, double lo, double hi, double *out, int64_t len) {
+  // a range with a nan or infinite bound is empty
+  if (!std::isfinite(lo) || !std::isfinite(hi)) {
+    return 0;
+  }
+  int64_t begin = std::max<int64_t>(0, to_index(lo));
+  int64_t end   = std::min<int64_t>(len, to_index(hi));
+  if (end <= begin) {
+    return 0;
+  }
+
+  int64_t n_chunks = (end - begin + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  Scheduler::get_instance().parallel_for(n_chunks, [&](int64_t c) {
+    int64_t chunk_begin = begin + c * CHUNK_SIZE;
+    int64_t chunk_end   = std::min(end, chunk_begin + CHUNK_SIZE);
+    for (int64_t i = chunk_begin; i < chunk_end; i ++) {
+      out[i] = fn(static_cast<double>(i));
+    }
+  });
+
+  return static_cast<double>(end - begin);
+}
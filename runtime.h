@@ -0,0 +1,82 @@
+#ifndef __KLANG_RUNTIME_H__
+#define __KLANG_RUNTIME_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Scheduler - a work-stealing scheduler that runs parallel builtins, each
+// thread owns a deque of tasks, pops its own tasks LIFO and steals others'
+// FIFO when it runs out of work
+class Scheduler {
+public:
+  // get_instance - gets the process-wide scheduler, one thread per core
+  static Scheduler &get_instance();
+
+public:
+  Scheduler(unsigned n_threads);
+  ~Scheduler();
+  // parallel_for - runs body(i) for each i in [0, n), returns when all done,
+  // the calling thread helps running tasks meanwhile, so it may be nested
+  void parallel_for(int64_t n, const std::function<void(int64_t)> &body);
+
+private:
+  // Job - a parallel_for in flight
+  struct Job {
+    const std::function<void(int64_t)> *body;
+    std::atomic<int64_t>                remaining;
+  };
+
+  // Task - a range [begin, end) of a job
+  struct Task {
+    Job     *job;
+    int64_t  begin;
+    int64_t  end;
+  };
+
+  // Deque - tasks owned by a thread
+  struct Deque {
+    std::mutex       mutex;
+    std::deque<Task> tasks;
+  };
+
+private:
+  // work - the loop run by each thread
+  void work(unsigned self);
+  // push - pushes a task to the deque of self
+  void push(unsigned self, const Task &task);
+  // pop_or_steal - pops a task of self, or steals one, returns false if none
+  bool pop_or_steal(unsigned self, Task &task);
+  // run - runs a task, splitting it in halves until a single index is left
+  void run(unsigned self, Task task);
+  // get_self - gets the deque index of the calling thread
+  unsigned get_self();
+
+private:
+  std::vector<std::thread>            threads;
+  std::vector<std::unique_ptr<Deque>> deques;    // one per thread, the last for external threads
+  std::atomic<int64_t>                n_tasks;
+  std::mutex                          idle_mutex;
+  std::condition_variable             idle_cond;
+  bool                                stopping = false;
+};
+
+// klang_fn - a klang function taking one argument
+typedef double (*klang_fn)(double);
+
+extern "C" {
+// klang_parallel_sum - sums fn(i) for each integer i in [lo, hi), the result
+// does not depend on the number of threads
+double klang_parallel_sum(klang_fn fn, double lo, double hi);
+// klang_parallel_map - stores fn(i) into out[i] for each integer i in
+// [lo, hi), which must be in [0, len), returns the number of stored values
+double klang_parallel_map(klang_fn fn, double lo, double hi, double *out, int64_t len);
+}
+
+#endif
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "server.h"
+
+// write_all - writes all of data to fd, returns false on failure
+static bool write_all(int fd, const std::string &data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t n = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+    if (n < 0 && EINTR == errno) { continue; }
+    if (n <= 0) { return false; }
+    written += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// record - records the latency of a request, in milliseconds
+void LatencyStats::record(double ms) {
+  std::lock_guard<std::mutex> lock(samples_mutex);
+  if (samples.size() < MAX_SAMPLES) {
+    samples.push_back(ms);
+  } else {
+    samples[next_sample] = ms;
+  }
+  next_sample = (next_sample + 1) % MAX_SAMPLES;
+  n_requests ++;
+}
+
+// report - reports the number of requests, and latency percentiles
+std::string LatencyStats::report() {
+  std::vector<double> sorted;
+  size_t n;
+  {
+    std::lock_guard<std::mutex> lock(samples_mutex);
+    sorted = samples;
+    n = n_requests;
+  }
+
+  std::ostringstream out;
+  out << "requests " << n << std::endl;
+  if (sorted.empty()) {
+    return out.str();
+  }
+
+  std::sort(sorted.begin(), sorted.end());
+  auto percentile = [&sorted](double p) {
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+  };
+  out << "latency_ms p50 " << percentile(0.50)
+      << " p90 "           << percentile(0.90)
+      << " p99 "           << percentile(0.99)
+      << " max "           << sorted.back() << std::endl;
+  return out.str();
+}
+
+Server::Connection::Connection(int fd, CodeCache &code_cache, const SessionLimits &limits)
+  : fd(fd), session(code_cache, limits) {}
+
+Server::Connection::~Connection() {
+  close(fd);
+}
+
+Server::Server(const std::string &socket_path, unsigned n_threads, const SessionLimits &limits)
+  : socket_path(socket_path), limits(limits), pool(n_threads) {}
+
+Server::~Server() {
+  if (listen_fd >= 0) {
+    close(listen_fd);
+    unlink(socket_path.c_str());
+  }
+  if (wake_fds[0] >= 0) {
+    close(wake_fds[0]);
+    close(wake_fds[1]);
+  }
+}
+
+// run - serves clients until stop is called, returns non-zero on failure
+int Server::run() {
+  if (pipe(wake_fds) < 0) {
+    std::cerr << "cannot create pipe: " << strerror(errno) << std::endl;
+    return 1;
+  }
+  fcntl(wake_fds[1], F_SETFL, O_NONBLOCK);
+
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "socket path too long" << std::endl;
+    return 1;
+  }
+  strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socket_path.c_str());
+  if (listen_fd < 0 ||
+      bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+      listen(listen_fd, SOMAXCONN) < 0) {
+    std::cerr << "cannot listen on " << socket_path << ": " << strerror(errno) << std::endl;
+    return 1;
+  }
+
+  std::cerr << "serving on " << socket_path << " with " << pool.get_size() << " threads" << std::endl;
+
+  std::vector<pollfd> fds;
+  while (1) {
+    fds.clear();
+    fds.push_back({wake_fds[0], POLLIN, 0});
+    fds.push_back({listen_fd, POLLIN, 0});
+    for (auto &c : connections) {
+      fds.push_back({c.first, POLLIN, 0});
+    }
+
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      if (EINTR == errno) { continue; }
+      std::cerr << "poll failed: " << strerror(errno) << std::endl;
+      return 1;
+    }
+
+    if (fds[0].revents) {
+      return 0; // stopped
+    }
+    if (fds[1].revents & POLLIN) {
+      accept_connection();
+    }
+    for (size_t i = 2; i < fds.size(); i ++) {
+      if (!fds[i].revents) { continue; }
+      auto c = connections.find(fds[i].fd);
+      if (!read_connection(c->second)) {
+        // the session is freed once its pending requests are drained
+        connections.erase(c);
+      }
+    }
+  }
+}
+
+// stop - makes run return, it is async-signal-safe
+void Server::stop() {
+  char c = 0;
+  if (write(wake_fds[1], &c, 1) < 0) {
+    // nothing can be done in a signal handler, the pipe is full anyway
+  }
+}
+
+// accept_connection - accepts a new client
+void Server::accept_connection() {
+  int fd = accept(listen_fd, nullptr, nullptr);
+  if (fd < 0) {
+    return;
+  }
+  connections[fd] = std::make_shared<Connection>(fd, code_cache, limits);
+}
+
+// read_connection - reads requests from conn, returns false if closed
+bool Server::read_connection(const std::shared_ptr<Connection> &conn) {
+  char data[4096];
+  ssize_t n = read(conn->fd, data, sizeof(data));
+  if (n < 0 && EINTR == errno) {
+    return true;
+  }
+  if (n <= 0) {
+    return false;
+  }
+
+  conn->buffer.append(data, static_cast<size_t>(n));
+
+  // a request never gets to a session if it is too large anyway
+  size_t end = conn->buffer.find('\n');
+  if (std::string::npos == end && conn->buffer.size() > limits.max_request_bytes) {
+    write_all(conn->fd, "request too large\n.\n");
+    return false;
+  }
+
+  bool schedule = false;
+  {
+    std::lock_guard<std::mutex> lock(conn->inbox_mutex);
+    size_t begin = 0;
+    for (; std::string::npos != end; begin = end + 1, end = conn->buffer.find('\n', begin)) {
+      conn->inbox.push_back(conn->buffer.substr(begin, end - begin));
+    }
+    conn->buffer.erase(0, begin);
+
+    if (!conn->inbox.empty() && !conn->scheduled) {
+      conn->scheduled = schedule = true;
+    }
+  }
+
+  if (schedule) {
+    pool.submit([this, conn] { drain(conn); });
+  }
+  return true;
+}
+
+// drain - evaluates all requests in the inbox of conn, in order
+void Server::drain(const std::shared_ptr<Connection> &conn) {
+  while (1) {
+    std::string request;
+    {
+      std::lock_guard<std::mutex> lock(conn->inbox_mutex);
+      if (conn->inbox.empty()) {
+        conn->scheduled = false;
+        return;
+      }
+      request = std::move(conn->inbox.front());
+      conn->inbox.pop_front();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::string response = handle(*conn, request);
+    std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - start;
+    latencies.record(latency.count());
+
+    write_all(conn->fd, response + ".\n");
+  }
+}
+
+// handle - handles a request of conn, and returns the response
+std::string Server::handle(Connection &conn, const std::string &request) {
+  if (":stats" == request) {
+    std::ostringstream out;
+    out << latencies.report()
+        << "code_cache hits " << code_cache.get_hits()
+        << " misses " << code_cache.get_misses() << std::endl;
+    return out.str();
+  }
+
+  return conn.session.eval(request);
+}
@@ -0,0 +1,81 @@
+#ifndef __KLANG_SERVER_H__
+#define __KLANG_SERVER_H__
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "session.h"
+#include "thread_pool.h"
+
+// LatencyStats - latencies of the most recent requests
+class LatencyStats {
+public:
+  enum { MAX_SAMPLES = 8192 };
+
+public:
+  // record - records the latency of a request, in milliseconds
+  void record(double ms);
+  // report - reports the number of requests, and latency percentiles
+  std::string report();
+
+private:
+  std::mutex          samples_mutex;
+  std::vector<double> samples;
+  size_t              next_sample = 0;
+  size_t              n_requests  = 0;
+};
+
+// Server - a server that runs many isolated sessions on a thread pool, one
+// session per client connected to a local unix domain socket.
+//
+// every line a client sends is a request, which is answered by the response
+// followed by a line with a single '.'. the request ":stats" reports server
+// statistics instead of being evaluated.
+class Server {
+public:
+  Server(const std::string &socket_path, unsigned n_threads, const SessionLimits &limits);
+  ~Server();
+  // run - serves clients until stop is called, returns non-zero on failure
+  int run();
+  // stop - makes run return, it is async-signal-safe
+  void stop();
+
+private:
+  // Connection - a connected client and its session
+  struct Connection {
+    Connection(int fd, CodeCache &code_cache, const SessionLimits &limits);
+    ~Connection();
+
+    int                     fd;
+    Session                 session;
+    std::string             buffer;            // bytes read but not yet a full line
+    std::mutex              inbox_mutex;
+    std::deque<std::string> inbox;             // requests not yet evaluated
+    bool                    scheduled = false; // whether a drain is pending
+  };
+
+private:
+  // accept_connection - accepts a new client
+  void accept_connection();
+  // read_connection - reads requests from conn, returns false if closed
+  bool read_connection(const std::shared_ptr<Connection> &conn);
+  // drain - evaluates all requests in the inbox of conn, in order
+  void drain(const std::shared_ptr<Connection> &conn);
+  // handle - handles a request of conn, and returns the response
+  std::string handle(Connection &conn, const std::string &request);
+
+private:
+  std::string                                  socket_path;
+  SessionLimits                                limits;
+  CodeCache                                    code_cache;
+  LatencyStats                                 latencies;
+  int                                          listen_fd = -1;
+  int                                          wake_fds[2] = {-1, -1};
+  std::map<int, std::shared_ptr<Connection>>   connections;
+  ThreadPool                                   pool;
+};
+
+#endif
@@ -0,0 +1,200 @@
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/Support/raw_ostream.h>
+#include "collector.h"
+#include "lexer.h"
+#include "parser.h"
+#include "printer.h"
+#include "session.h"
+
+// count_instructions - counts instructions of f
+static size_t count_instructions(const llvm::Function &f) {
+  size_t n = 0;
+  for (auto &bb : f) {
+    n += bb.size();
+  }
+  return n;
+}
+
+// lookup - looks up the codes compiled from key, returns false if missing
+bool CodeCache::lookup(const std::string &key, std::string &code) {
+  std::lock_guard<std::mutex> lock(codes_mutex);
+  auto c = codes.find(key);
+  if (codes.end() == c) {
+    misses ++;
+    return false;
+  }
+
+  hits ++;
+  code = c->second;
+  return true;
+}
+
+// insert - inserts the codes compiled from key
+void CodeCache::insert(const std::string &key, const std::string &code) {
+  std::lock_guard<std::mutex> lock(codes_mutex);
+  codes.emplace(key, code);
+}
+
+// get_id - gets the id of key, which is the same in all sessions
+size_t CodeCache::get_id(const std::string &key) {
+  std::lock_guard<std::mutex> lock(codes_mutex);
+  return ids.emplace(key, ids.size()).first->second;
+}
+
+// get_hits - gets the number of successful lookups
+size_t CodeCache::get_hits() {
+  std::lock_guard<std::mutex> lock(codes_mutex);
+  return hits;
+}
+
+// get_misses - gets the number of failed lookups
+size_t CodeCache::get_misses() {
+  std::lock_guard<std::mutex> lock(codes_mutex);
+  return misses;
+}
+
+Session::Session(CodeCache &code_cache, const SessionLimits &limits)
+  : code_cache(code_cache),
+    limits(limits),
+    output(),
+    code_gen(llvm::make_unique<CodeGenerator>(output)) {
+  // a definition from the cache is only declared in this session, so codes
+  // must not depend on the bodies of the functions they call, otherwise they
+  // would differ depending on whether those came from the cache
+  code_gen->set_specializing(false);
+}
+
+// eval - evaluates a request, and returns the response
+std::string Session::eval(const std::string &request) {
+  output.str("");
+
+  if (request.size() > limits.max_request_bytes) {
+    return "request too large\n";
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + limits.max_request_time;
+
+  std::istringstream input(request);
+  Lexer  lexer(input);
+  Parser parser(lexer, output);
+
+  lexer.advance();
+  while (lexer.get_curr_token() != Lexer::token_eof) {
+    if (std::chrono::steady_clock::now() > deadline) {
+      output << "time limit exceeded" << std::endl;
+      break;
+    }
+
+    if (';' == lexer.get_curr_token()) {
+      lexer.advance(); // eat ';'
+      continue;
+    }
+
+    auto ast = parser.parse_top();
+    if (!ast) {
+      lexer.advance(); // skip the erroneous token
+      continue;
+    }
+
+    eval_top(*ast);
+  }
+
+  return output.str();
+}
+
+// eval_top - evaluates a top level AST
+void Session::eval_top(AST &ast) {
+  if (auto *def = dynamic_cast<FunctionAST *>(&ast)) {
+    eval_definition(*def);
+    return;
+  }
+
+  ast.accept(*code_gen);
+  if (CodeGenerator::RET_TYPE_FUNCTION == code_gen->get_ret_type()) {
+    std::string code;
+    llvm::raw_string_ostream code_stream(code);
+    code_gen->get_ret_f()->print(code_stream);
+    output << "read function" << std::endl << code_stream.str() << std::endl;
+  }
+}
+
+// eval_definition - evaluates a definition, reusing cached codes if possible
+void Session::eval_definition(FunctionAST &ast) {
+  const std::string &name = ast.proto->name;
+  if (cached_defs.count(name)) {
+    output << "function cannot be redefined" << std::endl;
+    return;
+  }
+
+  // codes generated in another session are the same as those generated in
+  // this one, if the functions called resolve to the same ones
+  ASTPrinter printer;
+  ast.accept(printer);
+  std::string key = printer.get_ret_str() + '\n' + get_environment(ast);
+
+  // a cached definition only needs a declaration in this session, which is
+  // impossible if the name is already declared (and must be checked)
+  std::string code;
+  bool declared = !name.empty() && code_gen->get_module().getFunction(name);
+  if (!declared && code_cache.lookup(key, code)) {
+    if (!name.empty()) {
+      ast.proto->accept(*code_gen);
+      cached_defs.insert(name);
+      def_ids[name] = code_cache.get_id(key);
+    }
+    output << "read function" << std::endl << code << std::endl;
+    return;
+  }
+
+  if (n_instructions >= limits.max_instructions) {
+    output << "session memory limit exceeded" << std::endl;
+    return;
+  }
+
+  ast.accept(*code_gen);
+  if (CodeGenerator::RET_TYPE_FUNCTION != code_gen->get_ret_type()) {
+    return;
+  }
+
+  llvm::Function *f = code_gen->get_ret_f();
+  n_instructions += count_instructions(*f);
+
+  // specializations called by f are part of its codes
+  llvm::raw_string_ostream code_stream(code);
+  for (llvm::Function *spec : code_gen->take_specializations()) {
+    n_instructions += count_instructions(*spec);
+    spec->print(code_stream);
+  }
+  f->print(code_stream);
+  code_stream.flush();
+  code_cache.insert(key, code);
+  if (!name.empty()) {
+    def_ids[name] = code_cache.get_id(key);
+  }
+
+  output << "read function" << std::endl << code << std::endl;
+}
+
+// get_environment - gets what each function ast calls resolves to in this
+// session, which the codes generated for ast depend on: a definition by the
+// id of its own key, a declaration by its type, and any other name, i.e. a
+// builtin or an unknown function, by nothing
+std::string Session::get_environment(FunctionAST &ast) {
+  CallCollector collector;
+  ast.accept(collector);
+
+  std::string environment;
+  llvm::raw_string_ostream environment_stream(environment);
+  for (auto &callee : collector.get_callees()) {
+    environment_stream << callee << ':';
+    auto id = def_ids.find(callee);
+    const llvm::Function *f = code_gen->get_module().getFunction(callee);
+    if (def_ids.end() != id) {
+      environment_stream << 'd' << id->second;
+    } else if (f) {
+      environment_stream << 'e' << *f->getFunctionType();
+    }
+    environment_stream << ';';
+  }
+  return environment_stream.str();
+}
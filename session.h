@@ -0,0 +1,80 @@
+#ifndef __KLANG_SESSION_H__
+#define __KLANG_SESSION_H__
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include "ast.h"
+#include "codegen.h"
+
+// SessionLimits - resource limits of every session. sessions only generate
+// codes, which they never run, so the limits bound code generation
+struct SessionLimits {
+  // max_request_bytes - size of a single request
+  size_t                    max_request_bytes = 64 * 1024;
+  // max_instructions - llvm instructions a session may hold in its module,
+  // checked before generating each definition
+  size_t                    max_instructions  = 1 << 20;
+  // max_request_time - wall time a single request may take, checked before
+  // each top level, so a single top level is never interrupted
+  std::chrono::milliseconds max_request_time  = std::chrono::milliseconds(1000);
+};
+
+// CodeCache - compiled codes shared by all sessions, keyed by the canonical
+// form of the definition they are compiled from, and what the functions it
+// calls resolve to in the session compiling it
+class CodeCache {
+public:
+  // lookup - looks up the codes compiled from key, returns false if missing
+  bool lookup(const std::string &key, std::string &code);
+  // insert - inserts the codes compiled from key
+  void insert(const std::string &key, const std::string &code);
+  // get_id - gets the id of key, which is the same in all sessions
+  size_t get_id(const std::string &key);
+  // get_hits - gets the number of successful lookups
+  size_t get_hits();
+  // get_misses - gets the number of failed lookups
+  size_t get_misses();
+
+private:
+  std::mutex                                   codes_mutex;
+  std::unordered_map<std::string, std::string> codes;
+  std::unordered_map<std::string, size_t>      ids;
+  size_t                                       hits   = 0;
+  size_t                                       misses = 0;
+};
+
+// Session - an isolated evaluation session, which owns its own LLVMContext,
+// a session is not thread safe, but different sessions can run concurrently.
+// a session generates codes, and responds with them, but does not run them
+class Session {
+public:
+  Session(CodeCache &code_cache, const SessionLimits &limits);
+  // eval - evaluates a request, and returns the response
+  std::string eval(const std::string &request);
+
+private:
+  // eval_top - evaluates a top level AST
+  void eval_top(AST &ast);
+  // eval_definition - evaluates a definition, reusing cached codes if possible
+  void eval_definition(FunctionAST &ast);
+  // get_environment - gets what each function ast calls resolves to in this
+  // session, which the codes generated for ast depend on
+  std::string get_environment(FunctionAST &ast);
+
+private:
+  CodeCache                      &code_cache;
+  SessionLimits                   limits;
+  std::ostringstream              output;
+  std::unique_ptr<CodeGenerator>  code_gen;
+  std::set<std::string>           cached_defs;      // functions defined via code_cache
+  std::map<std::string, size_t>   def_ids;          // the id of the cache key of each definition
+  size_t                          n_instructions = 0;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#include <sstream>
+#include "../lexer.h"
+#include "../parser.h"
+#include "../printer.h"
+#include "test.h"
+
+// print - prints the canonical form of the top level src, parsed with
+// hash consing if hash_consing
+static std::string print(const std::string &src, bool hash_consing = false) {
+  std::istringstream in(src);
+  Lexer lexer(in);
+  Parser parser(lexer);
+  parser.set_hash_consing(hash_consing);
+  lexer.advance();
+  std::unique_ptr<AST> ast = parser.parse_top();
+  if (!ast) {
+    return "";
+  }
+  ASTPrinter printer;
+  ast->accept(printer);
+  return printer.get_ret_str();
+}
+
+// test_identical - checks that structurally identical definitions print
+// the same, however they are written
+static void test_identical() {
+  std::string f = print("def f(x) { x*2+1 }");
+  CHECK("def f(x) { ((x * 2) + 1) }" == f);
+  CHECK(f == print("def f(x) {\n  ((x * 2) + 1) # comment\n}"));
+  CHECK(f == print("def   f( x ) { (x*2) + (1) }"));
+  // the same double, however many digits it is written with
+  CHECK(print("def g(x) { x * 0.1 }") == print("def g(x) { x * 0.10000000000000001 }"));
+  // a shared expression prints as the expression it shares
+  CHECK(print("x * x + x * x") == print("x * x + x * x", true));
+}
+
+// test_different - checks that structurally different definitions print
+// differently
+static void test_different() {
+  CHECK(print("def f(x) { x*2+1 }") != print("def f(x) { x*(2+1) }"));
+  CHECK(print("def f(x) { x*2+1 }") != print("def f(y) { y*2+1 }"));
+  CHECK(print("def f(x) { x*2+1 }") != print("def g(x) { x*2+1 }"));
+  CHECK(print("def g(x) { x * 0.1 }") != print("def g(x) { x * 0.1000000000000001 }"));
+  CHECK(print("def f(a[]) { len(a) }") != print("def f(a) { len(a) }"));
+  CHECK(print("def f(x) { var a in a }") != print("def f(x) { var a = 0 in a }"));
+  CHECK(print("def f(x) { for i = 0, i < 9 in x }") != print("def f(x) { for i = 0, i < 9, 1 in x }"));
+}
+
+// test_round_trip - checks that the canonical form parses to itself
+static void test_round_trip() {
+  const char *sources[] = {
+    "def f(x) { x*2+1 }",
+    "def sum(a[]) { var s = 0 in (for i = 0, i < len(a) in s = s + a[i]) : s }",
+    "def f(x, y) { var a = x, b in for i = 0, i < y, 2 in b = a + g(i, 1.5) }",
+  };
+  for (auto *src : sources) {
+    std::string printed = print(src);
+    CHECK(!printed.empty() && printed == print(printed));
+  }
+}
+
+int main() {
+  test_identical();
+  test_different();
+  test_round_trip();
+  return TEST_RESULT;
+}
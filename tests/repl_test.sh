@@ -0,0 +1,110 @@
+#!/bin/sh
+# repl_test.sh - runs scripted REPL sessions of the klang at $1, and checks
+# the results they print, and the codes they generate (printed to stderr)
+
+KLANG=$1
+n_failures=0
+
+# run - runs a REPL session of the lines of input, with the flags $@
+run() {
+  output=$(printf '%s\n' "$input" | "$KLANG" "$@" 2>&1)
+}
+
+# expect - checks that the output of the last session has the line pattern
+expect() {
+  if ! printf '%s\n' "$output" | grep -q -- "$1"; then
+    echo "$0: expected \"$1\" in the output of:"
+    printf '%s\n' "$input"
+    n_failures=$((n_failures + 1))
+  fi
+}
+
+# expect_count - checks that the output of the last session has n lines
+# matching pattern
+expect_count() {
+  count=$(printf '%s\n' "$output" | grep -c -- "$2")
+  if [ "$count" -ne "$1" ]; then
+    echo "$0: expected $1 lines \"$2\", got $count in the output of:"
+    printf '%s\n' "$input"
+    n_failures=$((n_failures + 1))
+  fi
+}
+
+# redefinition - earlier callers call the latest version, unless its
+# arguments changed, and only with --jit
+input='def sq(x) { x * x }; def f(x) { sq(x) + 8 }; f(2)
+def sq(x) { x * x * x }; f(2)
+def inc(x) { x + 1 }; def g(x, y) { inc(x) * y }; g(2, 3)
+def inc(x, y) { x + y }; g(2, 3)
+def g(x, y) { inc(x, y) }; g(2, 3)'
+run --jit
+expect "evaluated to 12"
+expect "evaluated to 16"
+expect "evaluated to 9"
+expect "evaluated to 5"
+expect_count 2 "evaluated to 9"
+
+# a function declared by extern may be called before it is defined
+input='extern inc(x); def g(x) { inc(x) * 2 }; g(1)
+def inc(x) { x + 1 }; g(3)'
+run --jit
+expect "called a function which is declared, but not defined"
+expect "evaluated to 8"
+
+input='def sq(x) { x * x }; def sq(x) { x }'
+run
+expect "function cannot be redefined"
+
+# bounds traps - an index not proven in bounds is checked, and traps when it
+# is not, a loop bounded by the length of the array is not checked. arrays
+# are only passed in by the host, so the REPL can only check the codes
+input='def get(a[], k) { a[k] }
+def total(a[]) { var s in (for i = 0, i < len(a) in s = s + a[i]) : s }'
+run --jit
+expect "define double @get(double\* %a, i64 %a.len, double %k)"
+expect "fcmp oge double %k"
+expect_count 1 "call void @llvm.trap()"
+
+# loops - a loop over an array bounded by its length has no bounds checks,
+# and is vectorized on x86-64, a loop of a few passes is fully unrolled
+input='def scale(a[]) { for i = 0, i < len(a) in a[i] = a[i] * 2 }
+def poly(x) { var s = 0 in (for i = 0, i < 4 in s = s * x + i) : s }'
+run --jit
+expect_count 0 "llvm.trap"
+expect "%addtmp.3 = fadd double %multmp.3, 3.000000e+00"
+if [ "$(uname -m)" = x86_64 ]; then
+  expect "fmul <2 x double>"
+fi
+
+# parallel builtins
+input='def h(x) { x + 1 }; parallel_sum(h, 0, 4)
+def sq(x) { x * x }; parallel_sum(sq, 0, 0.5 - 1)
+def fill(a[]) { parallel_map(h, 0, len(a), a) }
+parallel_sum(h, 0)
+parallel_sum(3, 0, 4)
+def two(x, y) { x + y }; parallel_sum(two, 0, 4)
+def bad(a[]) { parallel_map(h, 0, 1, 2) }'
+run --jit
+expect "evaluated to 10"
+expect "evaluated to 0"
+expect "incorrect # arguments passed to parallel_sum"
+expect "expected a function as argument 1 of parallel_sum"
+expect "expected a function taking one number as argument 1 of parallel_sum"
+expect "expected an array as argument 4 of parallel_map"
+
+# commands - a line starting with ':' is a command, also after a top level
+# that reads on into the next line
+input='def inc(x) { x + 1 }
+:profile
+inc(2)
+:profile
+:unknown'
+run --jit --profile
+# reported by each command, and on exit
+expect_count 3 "flat profile, by self time:"
+expect " 1 .* inc$"
+expect "evaluated to 3"
+expect "unknown command"
+expect_count 0 "unknown variable"
+
+exit $((n_failures != 0))
@@ -0,0 +1,93 @@
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "../runtime.h"
+#include "test.h"
+
+static std::atomic<int> n_calls(0);
+
+// square - a klang function that squares its argument
+static double square(double x) {
+  n_calls ++;
+  return x * x;
+}
+
+// test_parallel_for - checks that each index runs exactly once, also when
+// parallel_for is nested in a task
+static void test_parallel_for() {
+  Scheduler scheduler(4);
+  std::vector<std::atomic<int>> runs(1000);
+  scheduler.parallel_for(1000, [&runs](int64_t i) { runs[i] ++; });
+  bool once = true;
+  for (auto &r : runs) {
+    once = once && 1 == r;
+  }
+  CHECK(once);
+
+  std::atomic<int64_t> sum(0);
+  scheduler.parallel_for(10, [&scheduler, &sum](int64_t i) {
+    scheduler.parallel_for(10, [&sum, i](int64_t j) { sum += i * 10 + j; });
+  });
+  CHECK(4950 == sum);
+
+  scheduler.parallel_for(0, [](int64_t) { CHECK(false); });
+}
+
+// test_parallel_sum - checks sums over integers in [lo, hi), which are the
+// same as summed serially, and empty for bad bounds
+static void test_parallel_sum() {
+  double serial = 0;
+  for (int i = 0; i < 100000; i ++) {
+    serial += 1.0 / (i + 1);
+  }
+  double parallel = klang_parallel_sum([](double x) { return 1.0 / (x + 1); }, 0, 100000);
+  CHECK(std::fabs(serial - parallel) < 1e-9);
+  // the result does not depend on the scheduling
+  CHECK(parallel == klang_parallel_sum([](double x) { return 1.0 / (x + 1); }, 0, 100000));
+
+  CHECK(285 == klang_parallel_sum(square, 0, 10));
+  CHECK(285 == klang_parallel_sum(square, -0.5, 9.5));
+  CHECK(0 == klang_parallel_sum(square, 10, 0));
+
+  double inf = std::numeric_limits<double>::infinity();
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  n_calls = 0;
+  CHECK(0 == klang_parallel_sum(square, 0, nan));
+  CHECK(0 == klang_parallel_sum(square, nan, 10));
+  CHECK(0 == klang_parallel_sum(square, 0, inf));
+  CHECK(0 == klang_parallel_sum(square, -inf, 0));
+  CHECK(0 == n_calls);
+  // bounds beyond 2^53 are clamped, rather than overflowing when converted
+  CHECK(0 == klang_parallel_sum(square, 1e300, 1e301));
+  CHECK(0 == n_calls);
+}
+
+// test_parallel_map - checks that only indices in [0, len) are stored
+static void test_parallel_map() {
+  std::vector<double> out(8, -1);
+  CHECK(8 == klang_parallel_map(square, 0, 8, out.data(), 8));
+  CHECK(49 == out[7]);
+
+  std::fill(out.begin(), out.end(), -1);
+  CHECK(3 == klang_parallel_map(square, 5, 100, out.data(), 8));
+  CHECK(-1 == out[4] && 25 == out[5] && 49 == out[7]);
+
+  std::fill(out.begin(), out.end(), -1);
+  CHECK(2 == klang_parallel_map(square, -10, 2, out.data(), 8));
+  CHECK(0 == out[0] && 1 == out[1] && -1 == out[2]);
+
+  n_calls = 0;
+  double inf = std::numeric_limits<double>::infinity();
+  CHECK(0 == klang_parallel_map(square, 0, inf, out.data(), 8));
+  CHECK(0 == klang_parallel_map(square, 0, std::numeric_limits<double>::quiet_NaN(), out.data(), 8));
+  CHECK(0 == klang_parallel_map(square, -1e300, 1e300, out.data(), 0));
+  CHECK(0 == n_calls);
+}
+
+int main() {
+  test_parallel_for();
+  test_parallel_sum();
+  test_parallel_map();
+  return TEST_RESULT;
+}
@@ -0,0 +1,22 @@
+#ifndef __KLANG_TEST_H__
+#define __KLANG_TEST_H__
+
+#include <iostream>
+
+// n_failures - the number of failed checks of the test program
+static int n_failures = 0;
+
+// CHECK - checks that cond holds, reports the check if not
+#define CHECK(cond)                                                       \
+  do {                                                                    \
+    if (!(cond)) {                                                        \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: "      \
+                << #cond << std::endl;                                    \
+      n_failures ++;                                                      \
+    }                                                                     \
+  } while (0)
+
+// TEST_RESULT - the exit status of the test program
+#define TEST_RESULT (n_failures ? 1 : 0)
+
+#endif
@@ -0,0 +1,128 @@
+#include <sstream>
+#include "../lexer.h"
+#include "../parser.h"
+#include "../typer.h"
+#include "test.h"
+
+// parse - parses the top level src, with hash consing if hash_consing
+static std::unique_ptr<FunctionAST> parse(const std::string &src, bool hash_consing = false) {
+  std::istringstream in(src);
+  Lexer lexer(in);
+  Parser parser(lexer);
+  parser.set_hash_consing(hash_consing);
+  lexer.advance();
+  std::unique_ptr<AST> ast = parser.parse_top();
+  return std::unique_ptr<FunctionAST>(dynamic_cast<FunctionAST *>(ast.release()));
+}
+
+// get_var - gets the VarExprAST of the body of f, "var v in (for ...) : v"
+static VarExprAST *get_var(const FunctionAST &f) {
+  return dynamic_cast<VarExprAST *>(f.body.get());
+}
+
+// get_for - gets the loop of the body of a "var v in (for ...) : v"
+static ForExprAST *get_for(const FunctionAST &f) {
+  auto *seq = dynamic_cast<BinaryExprAST *>(get_var(f)->body.get());
+  return dynamic_cast<ForExprAST *>(seq->lhs.get());
+}
+
+// test_loops - checks the types of loop variables and the variables they
+// assign, which are integers only if their bounds are within 2^53
+static void test_loops() {
+  TypeInferer typer;
+
+  // a loop over an array bounded by its length
+  auto sum = parse("def sum(a[]) { var s = 0 in (for i = 0, i < len(a) in s = s + a[i]) : s }");
+  typer.infer(*sum, true);
+  CHECK(TypeInferer::TYPE_INT    == typer.get_var_type(get_for(*sum)));
+  CHECK(TypeInferer::TYPE_DOUBLE == typer.get_var_type(&get_var(*sum)->vars[0]));
+  // len is an ordinary function if not the builtin
+  typer.infer(*sum, false);
+  CHECK(TypeInferer::TYPE_DOUBLE == typer.get_var_type(get_for(*sum)));
+
+  // the product of 1 to 25 is beyond 2^53
+  auto fact = parse("def fact(x) { var p = 1 in (for i = 1, i < 26 in p = p * i) : p }");
+  typer.infer(*fact, true);
+  CHECK(TypeInferer::TYPE_INT    == typer.get_var_type(get_for(*fact)));
+  CHECK(TypeInferer::TYPE_DOUBLE == typer.get_var_type(&get_var(*fact)->vars[0]));
+
+  // a variable assigned the loop variable is bounded as it is
+  auto last = parse("def last(x) { var c in (for i = 0, i < 10 in c = i) : c }");
+  typer.infer(*last, true);
+  CHECK(TypeInferer::TYPE_INT == typer.get_var_type(get_for(*last)));
+  CHECK(TypeInferer::TYPE_INT == typer.get_var_type(&get_var(*last)->vars[0]));
+
+  // a loop bounded by a double, assigning its variable, or stepping down is
+  // not bounded by its condition, so its variable grows until widened
+  const char *unbounded[] = {
+    "def f(n) { var c in (for i = 0, i < n in c = i) : c }",
+    "def f(x) { var c in (for i = 0, i < 10 in i = i + 1) : c }",
+    "def f(x) { var c in (for i = 0, i < 10, 0 - 1 in c = i) : c }",
+  };
+  for (auto *src : unbounded) {
+    auto f = parse(src);
+    typer.infer(*f, true);
+    CHECK(TypeInferer::TYPE_DOUBLE == typer.get_var_type(get_for(*f)));
+  }
+}
+
+// test_exprs - checks the types of operations, which are integers only if
+// their results are exact
+static void test_exprs() {
+  TypeInferer typer;
+
+  auto small = parse("2 * 3 + 1");
+  typer.infer(*small, true);
+  CHECK(TypeInferer::TYPE_INT == typer.get_expr_type(small->body.get()));
+
+  auto big = parse("100000000000 * 100000000000");
+  typer.infer(*big, true);
+  CHECK(TypeInferer::TYPE_DOUBLE == typer.get_expr_type(big->body.get()));
+
+  auto mixed = parse("2 * 0.5");
+  typer.infer(*mixed, true);
+  CHECK(TypeInferer::TYPE_DOUBLE == typer.get_expr_type(mixed->body.get()));
+
+  auto cmp = parse("1 < 2");
+  typer.infer(*cmp, true);
+  CHECK(TypeInferer::TYPE_BOOL == typer.get_expr_type(cmp->body.get()));
+
+  CHECK(TypeInferer::is_integral(9007199254740992.0));
+  CHECK(!TypeInferer::is_integral(18014398509481984.0));
+  CHECK(!TypeInferer::is_integral(0.5));
+}
+
+// test_shared - checks that a shared expression is of the same type in all
+// its occurrences, and so are the variables assigned it
+static void test_shared() {
+  TypeInferer typer;
+
+  auto f = parse("def f(a) { (var x = 1 in var y = 0 in y = x + 1) : (var x = a in x + 1) }", true);
+  typer.infer(*f, true);
+  auto *seq    = dynamic_cast<BinaryExprAST *>(f->body.get());
+  auto *var_x  = dynamic_cast<VarExprAST *>(seq->lhs.get());
+  auto *var_y  = dynamic_cast<VarExprAST *>(var_x->body.get());
+  auto *assign = dynamic_cast<BinaryExprAST *>(var_y->body.get());
+  auto *shared = dynamic_cast<SharedExprAST *>(assign->rhs.get());
+  CHECK(shared);
+  if (shared) {
+    // x + 1 is an integer in the first occurrence, a double in the second
+    CHECK(TypeInferer::TYPE_DOUBLE == typer.get_expr_type(shared->expr.get()));
+  }
+  CHECK(TypeInferer::TYPE_DOUBLE == typer.get_var_type(&var_y->vars[0]));
+  CHECK(TypeInferer::TYPE_INT    == typer.get_var_type(&var_x->vars[0]));
+
+  // without hash consing, each occurrence is typed on its own
+  auto g = parse("def g(a) { (var x = 1 in var y = 0 in y = x + 1) : (var x = a in x + 1) }");
+  typer.infer(*g, true);
+  seq   = dynamic_cast<BinaryExprAST *>(g->body.get());
+  var_y = dynamic_cast<VarExprAST *>(dynamic_cast<VarExprAST *>(seq->lhs.get())->body.get());
+  CHECK(TypeInferer::TYPE_INT == typer.get_var_type(&var_y->vars[0]));
+}
+
+int main() {
+  test_loops();
+  test_exprs();
+  test_shared();
+  return TEST_RESULT;
+}
@@ -0,0 +1,56 @@
+#include <algorithm>
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned n_threads) {
+  if (0 == n_threads) {
+    n_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (unsigned i = 0; i < n_threads; i ++) {
+    workers.emplace_back(&ThreadPool::work, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    stopping = true;
+  }
+  tasks_cond.notify_all();
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+// submit - submits a task to be run by some thread
+void ThreadPool::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    tasks.push_back(std::move(task));
+  }
+  tasks_cond.notify_one();
+}
+
+// get_size - gets the number of threads
+unsigned ThreadPool::get_size() const {
+  return static_cast<unsigned>(workers.size());
+}
+
+// work - the loop run by each thread
+void ThreadPool::work() {
+  while (1) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(tasks_mutex);
+      tasks_cond.wait(lock, [this] { return stopping || !tasks.empty(); });
+      // pending tasks are still run when stopping
+      if (tasks.empty()) {
+        return;
+      }
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef __KLANG_THREAD_POOL_H__
+#define __KLANG_THREAD_POOL_H__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ThreadPool - a fixed number of threads running submitted tasks in FIFO order
+class ThreadPool {
+public:
+  // a ThreadPool starts n_threads threads, or one per core if n_threads is 0
+  ThreadPool(unsigned n_threads = 0);
+  // the destructor runs all pending tasks and joins all threads
+  ~ThreadPool();
+  // submit - submits a task to be run by some thread
+  void submit(std::function<void()> task);
+  // get_size - gets the number of threads
+  unsigned get_size() const;
+
+private:
+  // work - the loop run by each thread
+  void work();
+
+private:
+  std::vector<std::thread>          workers;
+  std::deque<std::function<void()>> tasks;
+  std::mutex                        tasks_mutex;
+  std::condition_variable           tasks_cond;
+  bool                              stopping = false;
+};
+
+#endif
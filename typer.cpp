@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "typer.h"
+
+// MAX_EXACT - doubles count integers exactly up to 2^53, no array has more
+// elements either, as that is beyond the address space of any target
+static const double MAX_EXACT = 9007199254740992.0;
+
+// MAX_WIDENINGS - how many times the range of a variable may grow before it
+// is widened to a double, e.g. a counter in a loop grows on each pass
+static const unsigned MAX_WIDENINGS = 8;
+
+// make_range - makes the range of the integers in [lo, hi], or of doubles
+// if they are not all exact
+static TypeInferer::Range make_range(int type, double lo, double hi) {
+  if (TypeInferer::TYPE_DOUBLE == type || !(-MAX_EXACT <= lo && hi <= MAX_EXACT)) {
+    double inf = std::numeric_limits<double>::infinity();
+    return {TypeInferer::TYPE_DOUBLE, -inf, inf};
+  }
+  return {type, lo, hi};
+}
+
+// join - joins two ranges, a range of no values joins as the other one
+static TypeInferer::Range join(const TypeInferer::Range &a, const TypeInferer::Range &b) {
+  if (TypeInferer::TYPE_NONE == a.type) {
+    return b;
+  }
+  if (TypeInferer::TYPE_NONE == b.type) {
+    return a;
+  }
+  return make_range(std::max(a.type, b.type), std::min(a.lo, b.lo), std::max(a.hi, b.hi));
+}
+
+// infer - infers the types of the variables of ast, len(a) is taken as the
+// builtin (an integer) if len_builtin
+void TypeInferer::infer(const FunctionAST &ast, bool len_builtin) {
+  this->len_builtin = len_builtin;
+  var_ranges.clear();
+  widenings.clear();
+  reassigned.clear();
+  expr_types.clear();
+  visit(ast);
+}
+
+// get_var_type - gets the type of the variable declared by decl, which is
+// either a variable of a VarExprAST or a ForExprAST
+int TypeInferer::get_var_type(const void *decl) const {
+  return get_var_range(decl).type;
+}
+
+// get_expr_type - gets the type of the result of the BinaryExprAST ast
+int TypeInferer::get_expr_type(const ExprAST *ast) const {
+  auto t = expr_types.find(ast);
+  return expr_types.end() == t ? static_cast<int>(TYPE_DOUBLE) : t->second;
+}
+
+// is_integral - checks whether number can be an integer exactly, which
+// doubles can only promise up to 2^53
+bool TypeInferer::is_integral(double number) {
+  return std::floor(number) == number && std::fabs(number) <= MAX_EXACT;
+}
+
+// visit - infers the type of NumberExprAST
+void TypeInferer::visit(const NumberExprAST &ast) {
+  ret = make_range(is_integral(ast.val) ? TYPE_INT : TYPE_DOUBLE, ast.val, ast.val);
+}
+
+// visit - infers the type of VariableExprAST, a loop variable is bounded in
+// the body of the loop if its condition bounds it
+void TypeInferer::visit(const VariableExprAST &ast) {
+  auto v = scope.find(ast.name);
+  if (scope.end() == v) {
+    ret = make_range(TYPE_DOUBLE, 0, 0);
+    return;
+  }
+  auto b = bounded.find(v->second);
+  ret = bounded.end() == b ? get_var_range(v->second) : b->second;
+}
+
+// visit - infers the type of IndexExprAST, arrays hold doubles
+void TypeInferer::visit(const IndexExprAST &ast) {
+  ast.index->accept(*this);
+  ret = make_range(TYPE_DOUBLE, 0, 0);
+}
+
+// visit - infers the type of BinaryExprAST
+void TypeInferer::visit(const BinaryExprAST &ast) {
+  if (Lexer::operator_assign == ast.op) {
+    ast.rhs->accept(*this);
+    Range range = ret;
+    auto *var = dynamic_cast<VariableExprAST *>(strip_shared(ast.lhs.get()));
+    auto v = var ? scope.find(var->name) : scope.end();
+    if (scope.end() != v) {
+      assign(v->second, range);
+      reassigned.insert(v->second);
+      ret = get_var_range(v->second);
+    } else {
+      ast.lhs->accept(*this);
+      ret = make_range(TYPE_DOUBLE, 0, 0);
+    }
+    return;
+  }
+
+  ast.lhs->accept(*this);
+  Range l = ret;
+  ast.rhs->accept(*this);
+  Range r = ret;
+
+  // arithmetic on integers and booleans gives integers if the bounds of the
+  // result are exact, otherwise doubles
+  bool integral = TYPE_NONE < l.type && l.type < TYPE_DOUBLE && TYPE_NONE < r.type && r.type < TYPE_DOUBLE;
+  switch (ast.op) {
+  case Lexer::operator_seq:
+    ret = r; break;
+  case Lexer::operator_lt:
+    ret = make_range(TYPE_BOOL, 0, 1); break;
+  case Lexer::operator_add:
+    ret = make_range(integral ? TYPE_INT : TYPE_DOUBLE, l.lo + r.lo, l.hi + r.hi); break;
+  case Lexer::operator_sub:
+    ret = make_range(integral ? TYPE_INT : TYPE_DOUBLE, l.lo - r.hi, l.hi - r.lo); break;
+  case Lexer::operator_mul: {
+    double products[] = {l.lo * r.lo, l.lo * r.hi, l.hi * r.lo, l.hi * r.hi};
+    ret = make_range(integral ? TYPE_INT : TYPE_DOUBLE,
+                     *std::min_element(std::begin(products), std::end(products)),
+                     *std::max_element(std::begin(products), std::end(products)));
+    break;
+  }
+  default:
+    ret = make_range(TYPE_DOUBLE, 0, 0); break;
+  }
+
+  // a shared expression is generated once for all of its occurrences, so
+  // each of them is of the joined type, an occurrence already visited is
+  // visited again if the joined type widens
+  auto t = expr_types.find(&ast);
+  if (expr_types.end() == t) {
+    expr_types[&ast] = ret.type;
+  } else if (t->second < ret.type) {
+    t->second = ret.type;
+    changed   = true;
+  } else if (ret.type < t->second) {
+    ret = make_range(t->second, ret.lo, ret.hi);
+  }
+}
+
+// visit - infers the type of CallExprAST, functions return doubles, len(a)
+// returns an integer in [0, 2^53]
+void TypeInferer::visit(const CallExprAST &ast) {
+  for (auto &arg : ast.args) {
+    arg->accept(*this);
+  }
+  ret = len_builtin && "len" == ast.callee ? make_range(TYPE_INT, 0, MAX_EXACT) : make_range(TYPE_DOUBLE, 0, 0);
+}
+
+// visit - infers the type of SharedExprAST
+void TypeInferer::visit(const SharedExprAST &ast) {
+  ast.expr->accept(*this);
+}
+
+// visit - infers the type of VarExprAST
+void TypeInferer::visit(const VarExprAST &ast) {
+  std::vector<std::pair<std::string, const void *>> shadowed;
+  for (auto &var : ast.vars) {
+    // an uninitialized variable is 0
+    ret = make_range(TYPE_INT, 0, 0);
+    if (var.second) {
+      var.second->accept(*this);
+    }
+    assign(&var, ret);
+    shadowed.push_back(std::make_pair(var.first, bind(var.first, &var)));
+  }
+
+  ast.body->accept(*this);
+
+  for (auto v = shadowed.rbegin(); v != shadowed.rend(); ++ v) {
+    unbind(v->first, v->second);
+  }
+}
+
+// visit - infers the type of ForExprAST, the loop evaluates to 0.0. if the
+// condition is "var < bound" for an integer bound, the body never assigns
+// var, and the step is not negative, var is below the bound in the body and
+// the step, and at most bound - 1 + step after it
+void TypeInferer::visit(const ForExprAST &ast) {
+  ast.start->accept(*this);
+  Range start = ret;
+  assign(&ast, start);
+  const void *shadowed = bind(ast.var, &ast);
+
+  ast.end->accept(*this);
+
+  auto *cond = dynamic_cast<BinaryExprAST *>(strip_shared(ast.end.get()));
+  auto *var  = cond && Lexer::operator_lt == cond->op ? dynamic_cast<VariableExprAST *>(strip_shared(cond->lhs.get())) : nullptr;
+  if (var && ast.var == var->name && !reassigned.count(&ast) && TYPE_DOUBLE != start.type) {
+    cond->rhs->accept(*this);
+    Range bound = ret;
+    if (TYPE_NONE < bound.type && bound.type < TYPE_DOUBLE) {
+      bounded[&ast] = make_range(TYPE_INT, start.lo, std::max(start.lo, bound.hi - 1));
+      ret = make_range(TYPE_INT, 1, 1);
+      if (ast.step) {
+        ast.step->accept(*this);
+      }
+      if (TYPE_DOUBLE == ret.type || ret.lo < 0) {
+        bounded.erase(&ast);
+      } else {
+        assign(&ast, make_range(TYPE_INT, start.lo, bound.hi - 1 + ret.hi));
+      }
+    }
+  }
+
+  ast.body->accept(*this);
+  ret = make_range(TYPE_INT, 1, 1);
+  if (ast.step) {
+    ast.step->accept(*this);
+  }
+  Range step = ret;
+  Range curr = get_var_range(&ast);
+  auto b = bounded.find(&ast);
+  if (bounded.end() != b) {
+    curr = b->second;
+    bounded.erase(b);
+  }
+  bool integral = curr.type < TYPE_DOUBLE && TYPE_NONE < step.type && step.type < TYPE_DOUBLE;
+  assign(&ast, make_range(integral ? TYPE_INT : TYPE_DOUBLE, curr.lo + step.lo, curr.hi + step.hi));
+
+  unbind(ast.var, shadowed);
+  ret = make_range(TYPE_DOUBLE, 0, 0);
+}
+
+// visit - infers nothing for PrototypeAST
+void TypeInferer::visit(const PrototypeAST &) {
+  ret = {TYPE_NONE, 0, 0};
+}
+
+// visit - infers the types of the variables of FunctionAST, until none of
+// them changes any more
+void TypeInferer::visit(const FunctionAST &ast) {
+  var_ranges[ast.proto.get()] = make_range(TYPE_DOUBLE, 0, 0);
+  do {
+    changed = false;
+    scope.clear();
+    bounded.clear();
+    for (size_t i = 0; i < ast.proto->args.size(); i ++) {
+      if (!ast.proto->is_array_arg(i)) {
+        scope[ast.proto->args[i]] = ast.proto.get();
+      }
+    }
+    ast.body->accept(*this);
+  } while (changed);
+}
+
+// get_var_range - gets the range of the variable declared by decl, a
+// variable never assigned is never read either
+TypeInferer::Range TypeInferer::get_var_range(const void *decl) const {
+  auto r = var_ranges.find(decl);
+  return var_ranges.end() == r || TYPE_NONE == r->second.type ? make_range(TYPE_DOUBLE, 0, 0) : r->second;
+}
+
+// assign - joins range into the range of the variable declared by decl
+void TypeInferer::assign(const void *decl, const Range &range) {
+  auto r = var_ranges.find(decl);
+  Range old    = var_ranges.end() == r ? Range{TYPE_NONE, 0, 0} : r->second;
+  Range joined = join(old, range);
+  if (joined.type == old.type && joined.lo == old.lo && joined.hi == old.hi) {
+    return;
+  }
+  if (++ widenings[decl] > MAX_WIDENINGS) {
+    joined = make_range(TYPE_DOUBLE, 0, 0);
+  }
+  var_ranges[decl] = joined;
+  changed          = true;
+}
+
+// bind - brings the variable declared by decl into scope as name, returns
+// the declaration it shadows, or nullptr
+const void *TypeInferer::bind(const std::string &name, const void *decl) {
+  auto v = scope.find(name);
+  const void *shadowed = scope.end() == v ? nullptr : v->second;
+  scope[name] = decl;
+  return shadowed;
+}
+
+// unbind - restores the declaration of name shadowed by bind
+void TypeInferer::unbind(const std::string &name, const void *shadowed) {
+  if (shadowed) {
+    scope[name] = shadowed;
+  } else {
+    scope.erase(name);
+  }
+}
@@ -0,0 +1,92 @@
+#ifndef __KLANG_TYPER_H__
+#define __KLANG_TYPER_H__
+
+#include <map>
+#include <set>
+#include <string>
+#include "ast.h"
+
+// TypeInferer - TypeInferer is a visitor that infers the numeric type of
+// each mutable variable and each operation of a function, so a value that
+// only ever holds integers or booleans is kept in an integer register rather
+// than a double. an integer is only inferred where the bounds of all its
+// values are within 2^53, so integer operations give exactly the results
+// double ones would
+class TypeInferer : public Visitor {
+public:
+  // types are ordered, the join of two types is the greater one
+  enum { TYPE_NONE = 0, TYPE_BOOL = 1, TYPE_INT = 2, TYPE_DOUBLE = 3 };
+
+  // Range - the type of values, and their bounds if they are integers or
+  // booleans
+  struct Range {
+    int    type;
+    double lo;
+    double hi;
+  };
+
+public:
+  // infer - infers the types of the variables of ast, len(a) is taken as the
+  // builtin (an integer) if len_builtin
+  void infer(const FunctionAST &ast, bool len_builtin);
+  // get_var_type - gets the type of the variable declared by decl, which is
+  // either a variable of a VarExprAST or a ForExprAST
+  int get_var_type(const void *decl) const;
+  // get_expr_type - gets the type of the result of the BinaryExprAST ast
+  int get_expr_type(const ExprAST *ast) const;
+  // is_integral - checks whether number can be an integer exactly
+  static bool is_integral(double number);
+  // visit - infers the type of NumberExprAST
+  void visit(const NumberExprAST &ast) override;
+  // visit - infers the type of VariableExprAST
+  void visit(const VariableExprAST &ast) override;
+  // visit - infers the type of IndexExprAST
+  void visit(const IndexExprAST &ast) override;
+  // visit - infers the type of BinaryExprAST
+  void visit(const BinaryExprAST &ast) override;
+  // visit - infers the type of CallExprAST
+  void visit(const CallExprAST &ast) override;
+  // visit - infers the type of SharedExprAST
+  void visit(const SharedExprAST &ast) override;
+  // visit - infers the type of VarExprAST
+  void visit(const VarExprAST &ast) override;
+  // visit - infers the type of ForExprAST
+  void visit(const ForExprAST &ast) override;
+  // visit - infers nothing for PrototypeAST
+  void visit(const PrototypeAST &ast) override;
+  // visit - infers the types of the variables of FunctionAST
+  void visit(const FunctionAST &ast) override;
+
+private:
+  // get_var_range - gets the range of the variable declared by decl
+  Range get_var_range(const void *decl) const;
+  // assign - joins range into the range of the variable declared by decl
+  void assign(const void *decl, const Range &range);
+  // bind - brings the variable declared by decl into scope as name, returns
+  // the declaration it shadows, or nullptr
+  const void *bind(const std::string &name, const void *decl);
+  // unbind - restores the declaration of name shadowed by bind
+  void unbind(const std::string &name, const void *shadowed);
+
+private:
+  // var_ranges maps each declaration to the range of its variable
+  std::map<const void *, Range>             var_ranges;
+  // widenings counts how many times the range of each variable has grown,
+  // a variable growing too often is widened to a double
+  std::map<const void *, unsigned>          widenings;
+  // bounded maps each loop variable in a body where the loop condition
+  // bounds it to its range there
+  std::map<const void *, Range>             bounded;
+  // reassigned are the loop variables assigned other than by the step
+  std::set<const void *>                    reassigned;
+  // expr_types maps each BinaryExprAST to the type of its result
+  std::map<const ExprAST *, int>            expr_types;
+  // scope maps each variable in scope to its declaration, the PrototypeAST
+  // for an argument, which is always a double
+  std::map<std::string, const void *>       scope;
+  bool                                      len_builtin = true;
+  bool                                      changed     = false;
+  Range                                     ret         = {TYPE_NONE, 0, 0};
+};
+
+#endif
@@ -0,0 +1,250 @@
+#include <sys/stat.h>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <llvm/Support/raw_ostream.h>
+#include "parser.h"
+#include "printer.h"
+#include "watch.h"
+
+Watcher::Watcher(const std::string &path, CodeGenerator &code_gen, JIT *jit)
+  : path(path),
+    code_gen(code_gen),
+    jit(jit) {
+  code_gen.set_redefinable(true);
+}
+
+// set_hash_consing - parses the file with hash consing if enabled
+void Watcher::set_hash_consing(bool enabled) {
+  hash_consing = enabled;
+}
+
+// set_perf_listener - tells perf_listener the source location of each
+// function compiled, which must be registered with the jit
+void Watcher::set_perf_listener(PerfMapListener *perf_listener) {
+  this->perf_listener = perf_listener;
+}
+
+// run - compiles the file whenever it changes until stop is called,
+// returns non-zero on failure
+int Watcher::run() {
+  struct stat last = {};
+  bool loaded = false;
+  while (!stopping) {
+    struct stat st;
+    if (stat(path.c_str(), &st) < 0) {
+      if (!loaded) {
+        std::cerr << "cannot watch " << path << std::endl;
+        return 1;
+      }
+    } else if (!loaded || st.st_mtim.tv_sec != last.st_mtim.tv_sec ||
+               st.st_mtim.tv_nsec != last.st_mtim.tv_nsec || st.st_size != last.st_size) {
+      last   = st;
+      loaded = true;
+      reload();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+  }
+  return 0;
+}
+
+// stop - makes run return, it is async-signal-safe
+void Watcher::stop() {
+  stopping = 1;
+}
+
+// reload - reads the file, and compiles what changed since the last reload
+void Watcher::reload() {
+  auto begin = std::chrono::steady_clock::now();
+
+  std::ifstream input(path);
+  if (!input) {
+    std::cerr << "cannot read " << path << std::endl;
+    return;
+  }
+
+  // parses the whole file, skipping erroneous tokens like a session does
+  std::vector<std::unique_ptr<AST>> tops;
+  Lexer  lexer(input);
+  // functions defined by earlier reloads may be called before their
+  // definitions in the file
+  Parser parser(lexer);
+  parser.set_hash_consing(hash_consing);
+  for (auto &f : code_gen.get_module()) {
+    if (!f.empty() && f.hasName()) {
+      parser.set_defined(f.getName().str());
+    }
+  }
+  lexer.advance();
+  while (lexer.get_curr_token() != Lexer::token_eof) {
+    if (';' == lexer.get_curr_token()) {
+      lexer.advance(); // eat ';'
+      continue;
+    }
+
+    auto ast = parser.parse_top();
+    if (!ast) {
+      lexer.advance(); // skip the erroneous token
+      continue;
+    }
+    tops.push_back(std::move(ast));
+  }
+
+  // finds the definitions changed, the ones whose prototypes changed, and
+  // what each definition calls
+  std::map<std::string, size_t>                new_hashes;
+  std::map<std::string, size_t>                new_proto_hashes;
+  std::map<std::string, std::set<std::string>> callees;
+  std::set<std::string>                        changed;
+  std::set<std::string>                        reshaped;
+  for (auto &top : tops) {
+    auto *def = dynamic_cast<FunctionAST *>(top.get());
+    if (!def || def->proto->name.empty()) {
+      continue;
+    }
+
+    const std::string &name = def->proto->name;
+    ASTPrinter printer;
+    def->accept(printer);
+    size_t hash = std::hash<std::string>()(printer.get_ret_str());
+    auto h = hashes.find(name);
+    if (hashes.end() == h || h->second != hash) {
+      changed.insert(name);
+    }
+    new_hashes[name] = hash;
+
+    def->proto->accept(printer);
+    size_t proto_hash = std::hash<std::string>()(printer.get_ret_str());
+    auto p = proto_hashes.find(name);
+    if (proto_hashes.end() == p || p->second != proto_hash) {
+      reshaped.insert(name);
+    }
+    new_proto_hashes[name] = proto_hash;
+
+    CallCollector collector;
+    def->accept(collector);
+    callees[name] = collector.get_callees();
+  }
+
+  // a caller of a definition whose prototype changed, or which is new (and
+  // may replace a builtin), is generated again, other callers call the new
+  // definition via its slot
+  auto calls_any = [](const std::set<std::string> &names, const std::set<std::string> &of) {
+    for (auto &name : names) {
+      if (of.count(name)) {
+        return true;
+      }
+    }
+    return false;
+  };
+  std::set<std::string> recompiled = changed;
+  for (auto &c : callees) {
+    if (calls_any(c.second, reshaped)) {
+      recompiled.insert(c.first);
+    }
+  }
+
+  // expressions calling recompiled definitions, directly or indirectly, are
+  // evaluated again
+  std::set<std::string> affected = recompiled;
+  auto calls_affected = [&affected, &calls_any](const std::set<std::string> &names) {
+    return calls_any(names, affected);
+  };
+  for (bool grown = true; grown; ) {
+    grown = false;
+    for (auto &c : callees) {
+      if (!affected.count(c.first) && calls_affected(c.second)) {
+        affected.insert(c.first);
+        grown = true;
+      }
+    }
+  }
+
+  // compiles in the order of the file, in which callees come first
+  std::set<std::string> new_expressions;
+  unsigned n_compiled = 0;
+  for (auto &top : tops) {
+    if (auto *proto = dynamic_cast<PrototypeAST *>(top.get())) {
+      if (!code_gen.get_module().getFunction(proto->name)) {
+        proto->accept(code_gen);
+      }
+      continue;
+    }
+
+    auto &def = static_cast<FunctionAST &>(*top);
+    const std::string &name = def.proto->name;
+    if (name.empty()) {
+      ASTPrinter printer;
+      def.accept(printer);
+      std::string key = printer.get_ret_str();
+      CallCollector collector;
+      def.accept(collector);
+      if (!expressions.count(key) || calls_affected(collector.get_callees())) {
+        compile(def);
+      }
+      new_expressions.insert(key);
+    } else if (recompiled.count(name)) {
+      n_compiled ++;
+      // a definition failed is compiled again on the next reload
+      if (!compile(def)) {
+        new_hashes.erase(name);
+        new_proto_hashes.erase(name);
+      }
+    }
+  }
+  hashes.swap(new_hashes);
+  proto_hashes.swap(new_proto_hashes);
+  expressions.swap(new_expressions);
+
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+  std::cout << "reloaded " << path << ": compiled " << n_compiled << " of " << hashes.size()
+            << " definitions in " << ms << " ms" << std::endl;
+}
+
+// compile - generates codes for ast, compiles and evaluates them with the
+// jit if any, returns false if failed
+bool Watcher::compile(FunctionAST &ast) {
+  ast.accept(code_gen);
+  if (CodeGenerator::RET_TYPE_FUNCTION != code_gen.get_ret_type()) {
+    return false;
+  }
+
+  llvm::Function *f = code_gen.get_ret_f();
+  auto specs = code_gen.take_specializations();
+  if (!jit) {
+    for (llvm::Function *spec : specs) {
+      spec->print(llvm::errs());
+    }
+    f->print(llvm::errs());
+    return true;
+  }
+
+  // specializations called by f are compiled before f
+  for (llvm::Function *spec : specs) {
+    std::string symbol = jit->make_symbol(*spec);
+    if (perf_listener) {
+      perf_listener->set_location(symbol, spec->getName().str(), path, 0);
+    }
+    jit->add(*spec, symbol);
+  }
+  std::string symbol = jit->make_symbol(*f);
+  if (perf_listener) {
+    std::string name = f->getName().empty() ? "<toplevel>" : f->getName().str();
+    perf_listener->set_location(symbol, name, path, ast.proto->line);
+  }
+  if (!jit->add(*f, symbol)) {
+    std::cerr << "cannot compile function" << std::endl;
+    return false;
+  }
+
+  // evaluates a top level expression
+  if (f->getName().empty()) {
+    auto fp = reinterpret_cast<double (*)()>(jit->get_address(symbol));
+    if (fp) {
+      std::cout << "evaluated to " << fp() << std::endl;
+    }
+  }
+  return true;
+}
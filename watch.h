@@ -0,0 +1,60 @@
+#ifndef __KLANG_WATCH_H__
+#define __KLANG_WATCH_H__
+
+#include <csignal>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include "ast.h"
+#include "codegen.h"
+#include "collector.h"
+#include "jit.h"
+#include "perf_map.h"
+
+// Watcher - Watcher compiles a source file, and compiles it again whenever
+// it changes. only definitions whose contents changed are generated again,
+// along with the callers of those whose prototypes changed, other callers
+// call the new versions via their slots in the jit. top level expressions
+// are evaluated again if they, or functions they call, changed.
+class Watcher {
+public:
+  enum { POLL_INTERVAL_MS = 50 };
+
+public:
+  // a Watcher compiles path with code_gen, and runs it with jit if not nullptr
+  Watcher(const std::string &path, CodeGenerator &code_gen, JIT *jit);
+  // set_hash_consing - parses the file with hash consing if enabled
+  void set_hash_consing(bool enabled);
+  // set_perf_listener - tells perf_listener the source location of each
+  // function compiled, which must be registered with the jit
+  void set_perf_listener(PerfMapListener *perf_listener);
+  // run - compiles the file whenever it changes until stop is called,
+  // returns non-zero on failure
+  int run();
+  // stop - makes run return, it is async-signal-safe
+  void stop();
+  // reload - reads the file, and compiles what changed since the last reload
+  void reload();
+
+private:
+  // compile - generates codes for ast, compiles and evaluates them with the
+  // jit if any, returns false if failed
+  bool compile(FunctionAST &ast);
+
+private:
+  std::string                    path;
+  CodeGenerator                 &code_gen;
+  JIT                           *jit;
+  PerfMapListener               *perf_listener = nullptr;
+  bool                           hash_consing  = false;
+  // hashes maps each definition compiled to the hash of its contents
+  std::map<std::string, size_t>  hashes;
+  // proto_hashes maps each definition compiled to the hash of its prototype
+  std::map<std::string, size_t>  proto_hashes;
+  // expressions are the top level expressions evaluated
+  std::set<std::string>          expressions;
+  volatile std::sig_atomic_t     stopping = 0;
+};
+
+#endif